@@ -1,6 +1,16 @@
 format ELF64
 
 section '.text' executable
+public _start
+extrn starc_main
+; the kernel starts with 'argc' on top of the stack followed by 'argv' and 'envp', already 16 byte aligned
+_start:
+  mov rdi, [rsp]
+  lea rsi, [rsp+8]
+  lea rdx, [rsi+rdi*8+8]
+  call starc_main
+  ud2
+
 public __syscall__
 __syscall__:
   mov rax, rdi
@@ -12,3 +22,444 @@ __syscall__:
   mov r9,  [rsp+8]
   syscall
   ret
+
+; threads and atomics for the thread pool, the atomics are locked instructions so they're also full barriers
+public thread_spawn
+public atomic_add
+public atomic_cas
+
+CLONE_THREAD_FLAGS = 0x350f00 ; vm, fs, files, sighand, thread, sysvsem, parent_settid and child_cleartid
+
+; u64 thread_spawn(void *stack_top, void (*fn)(void *), void *arg, u64 *tid), the new thread runs 'fn(arg)' on
+; 'stack_top' and exits when it returns. the thread id goes on the low half of '*tid' before either thread goes
+; on and the kernel clears it, with a futex wake, once the thread is gone. returns the thread id or a negative
+; error
+thread_spawn:
+  ; the child starts with nothing but the new stack, so 'fn' and 'arg' go on it
+  sub rdi, 16
+  mov [rdi], rsi
+  mov [rdi+8], rdx
+  mov rsi, rdi
+  mov edi, CLONE_THREAD_FLAGS
+  mov rdx, rcx
+  mov r10, rcx
+  xor r8d, r8d
+  mov eax, 56 ; clone
+  syscall
+  test rax, rax
+  jnz .parent
+  pop rax
+  pop rdi
+  call rax
+  xor edi, edi
+  mov eax, 60 ; exit, only this thread
+  syscall
+.parent:
+  ret
+
+; u64 atomic_add(u64 *p, u64 value), returns what '*p' was before
+atomic_add:
+  mov rax, rsi
+  lock xadd [rdi], rax
+  ret
+
+; u64 atomic_cas(u64 *p, u64 expected, u64 desired), true when '*p' was 'expected' and now is 'desired'
+atomic_cas:
+  mov rax, rsi
+  lock cmpxchg [rdi], rdx
+  sete al
+  movzx eax, al
+  ret
+
+; memory primitives. sse2 is always there on x86-64 so it's the baseline, 'mem_init' switches the scans to
+; avx2 and lowers the 'rep' threshold when the cpu has fast 'rep movsb'/'rep stosb' (erms)
+public mem_init
+public mem_copy
+public mem_set
+public mem_eq
+public mem_find
+public mem_cstr_len
+public memcpy ; gcc is allowed to emit calls to these two by itself, even with -nostdlib
+public memset
+
+; void mem_init(void)
+mem_init:
+  push rbx
+  xor eax, eax
+  cpuid
+  cmp eax, 7
+  jb .done
+  mov eax, 7
+  xor ecx, ecx
+  cpuid
+  mov r8d, ebx
+  test r8d, 1 shl 9 ; erms
+  jz .avx2
+  mov qword [mem_rep_min], 256
+.avx2:
+  test r8d, 1 shl 5 ; avx2
+  jz .done
+  mov eax, 1
+  cpuid
+  and ecx, 3 shl 27 ; osxsave and avx
+  cmp ecx, 3 shl 27
+  jne .done
+  xor ecx, ecx
+  xgetbv
+  and eax, 6 ; the os saves both xmm and ymm state
+  cmp eax, 6
+  jne .done
+  mov byte [mem_avx2], 1
+.done:
+  pop rbx
+  ret
+
+; void *mem_copy(void *dst, const void *src, u64 len), the buffers must not overlap
+mem_copy:
+memcpy:
+  mov rax, rdi
+  cmp rdx, 16
+  jb .small
+  cmp rdx, [mem_rep_min]
+  jae .rep
+  ; 16 bytes at a time, the last block is loaded first and may overlap the one before it
+  movdqu xmm1, [rsi+rdx-16]
+  lea rcx, [rdi+rdx-16]
+.block:
+  movdqu xmm0, [rsi]
+  movdqu [rdi], xmm0
+  add rsi, 16
+  add rdi, 16
+  sub rdx, 16
+  cmp rdx, 16
+  ja .block
+  movdqu [rcx], xmm1
+  ret
+.rep:
+  mov rcx, rdx
+  rep movsb
+  ret
+.small:
+  cmp edx, 8
+  jb .small4
+  mov r8, [rsi]
+  mov r9, [rsi+rdx-8]
+  mov [rdi], r8
+  mov [rdi+rdx-8], r9
+  ret
+.small4:
+  cmp edx, 4
+  jb .small1
+  mov r8d, [rsi]
+  mov r9d, [rsi+rdx-4]
+  mov [rdi], r8d
+  mov [rdi+rdx-4], r9d
+  ret
+.small1:
+  test edx, edx
+  jz .done
+  ; first, middle and last byte cover every length from 1 to 3
+  mov rcx, rdx
+  shr rcx, 1
+  movzx r8d, byte [rsi]
+  movzx r9d, byte [rsi+rcx]
+  movzx r10d, byte [rsi+rdx-1]
+  mov [rdi], r8b
+  mov [rdi+rcx], r9b
+  mov [rdi+rdx-1], r10b
+.done:
+  ret
+
+; void *mem_set(void *dst, u64 c, u64 len)
+mem_set:
+memset:
+  mov r11, rdi
+  movzx esi, sil
+  mov r8, 0x0101010101010101
+  imul rsi, r8
+  cmp rdx, 16
+  jb .small
+  cmp rdx, [mem_rep_min]
+  jae .rep
+  movq xmm0, rsi
+  punpcklqdq xmm0, xmm0
+  movdqu [rdi+rdx-16], xmm0
+.block:
+  movdqu [rdi], xmm0
+  add rdi, 16
+  sub rdx, 16
+  cmp rdx, 16
+  ja .block
+  mov rax, r11
+  ret
+.rep:
+  mov rcx, rdx
+  mov eax, esi
+  rep stosb
+  mov rax, r11
+  ret
+.small:
+  cmp edx, 8
+  jb .small4
+  mov [rdi], rsi
+  mov [rdi+rdx-8], rsi
+  mov rax, r11
+  ret
+.small4:
+  cmp edx, 4
+  jb .small1
+  mov [rdi], esi
+  mov [rdi+rdx-4], esi
+  mov rax, r11
+  ret
+.small1:
+  test edx, edx
+  jz .done
+  mov rcx, rdx
+  shr rcx, 1
+  mov [rdi], sil
+  mov [rdi+rcx], sil
+  mov [rdi+rdx-1], sil
+.done:
+  mov rax, r11
+  ret
+
+; u64 mem_eq(const void *a, const void *b, u64 len), 1 if the 'len' bytes are equal
+mem_eq:
+  cmp byte [mem_avx2], 0
+  je mem_eq_sse2
+  cmp rdx, 32
+  jb mem_eq_sse2
+  vmovdqu ymm0, [rdi+rdx-32]
+  vpcmpeqb ymm0, ymm0, [rsi+rdx-32]
+  vpmovmskb eax, ymm0
+  cmp eax, -1
+  jne .ne
+.block:
+  vmovdqu ymm0, [rdi]
+  vpcmpeqb ymm0, ymm0, [rsi]
+  vpmovmskb eax, ymm0
+  cmp eax, -1
+  jne .ne
+  add rdi, 32
+  add rsi, 32
+  sub rdx, 32
+  cmp rdx, 32
+  ja .block
+  vzeroupper
+  mov eax, 1
+  ret
+.ne:
+  vzeroupper
+  xor eax, eax
+  ret
+
+mem_eq_sse2:
+  cmp rdx, 16
+  jb .small
+  movdqu xmm0, [rdi+rdx-16]
+  movdqu xmm1, [rsi+rdx-16]
+  pcmpeqb xmm0, xmm1
+  pmovmskb eax, xmm0
+  cmp eax, 0xffff
+  jne .ne
+.block:
+  movdqu xmm0, [rdi]
+  movdqu xmm1, [rsi]
+  pcmpeqb xmm0, xmm1
+  pmovmskb eax, xmm0
+  cmp eax, 0xffff
+  jne .ne
+  add rdi, 16
+  add rsi, 16
+  sub rdx, 16
+  cmp rdx, 16
+  ja .block
+  mov eax, 1
+  ret
+.ne:
+  xor eax, eax
+  ret
+.small:
+  cmp edx, 8
+  jb .small4
+  mov rax, [rdi]
+  xor rax, [rsi]
+  mov rcx, [rdi+rdx-8]
+  xor rcx, [rsi+rdx-8]
+  or rax, rcx
+  jmp .test
+.small4:
+  cmp edx, 4
+  jb .small1
+  mov eax, [rdi]
+  xor eax, [rsi]
+  mov ecx, [rdi+rdx-4]
+  xor ecx, [rsi+rdx-4]
+  or eax, ecx
+  jmp .test
+.small1:
+  xor eax, eax
+  test edx, edx
+  jz .test
+  mov rcx, rdx
+  shr rcx, 1
+  movzx eax, byte [rdi]
+  movzx r8d, byte [rsi]
+  xor eax, r8d
+  movzx r8d, byte [rdi+rcx]
+  movzx r9d, byte [rsi+rcx]
+  xor r8d, r9d
+  or eax, r8d
+  movzx r8d, byte [rdi+rdx-1]
+  movzx r9d, byte [rsi+rdx-1]
+  xor r8d, r9d
+  or eax, r8d
+.test:
+  test rax, rax
+  setz al
+  movzx eax, al
+  ret
+
+; u64 mem_find(const void *buf, u64 c, u64 len), index of the first byte equal to 'c', or 'len'.
+; the scans only do aligned loads, so reading past either end of the buffer never touches another page
+mem_find:
+  mov rax, rdx
+  test rdx, rdx
+  jz .done
+  cmp byte [mem_avx2], 0
+  je mem_find_sse2
+  vmovd xmm1, esi
+  vpbroadcastb ymm1, xmm1
+  mov r8, rdi
+  and r8, -32
+  vpcmpeqb ymm0, ymm1, [r8]
+  vpmovmskb r10d, ymm0
+  mov ecx, edi
+  and ecx, 31
+  shr r10d, cl
+  test r10d, r10d
+  jnz .found_first
+  lea r9, [rdi+rdx]
+.block:
+  add r8, 32
+  cmp r8, r9
+  jae .none
+  vpcmpeqb ymm0, ymm1, [r8]
+  vpmovmskb r10d, ymm0
+  test r10d, r10d
+  jz .block
+  bsf r10d, r10d
+  add r10, r8
+  sub r10, rdi
+  cmp r10, rdx
+  cmovb rax, r10
+.none:
+  vzeroupper
+.done:
+  ret
+.found_first:
+  vzeroupper
+  bsf r10d, r10d
+  cmp r10, rdx
+  cmovb rax, r10
+  ret
+
+mem_find_sse2:
+  movd xmm1, esi
+  punpcklbw xmm1, xmm1
+  punpcklwd xmm1, xmm1
+  pshufd xmm1, xmm1, 0
+  mov r8, rdi
+  and r8, -16
+  movdqa xmm0, [r8]
+  pcmpeqb xmm0, xmm1
+  pmovmskb r10d, xmm0
+  mov ecx, edi
+  and ecx, 15
+  shr r10d, cl
+  test r10d, r10d
+  jnz .found_first
+  lea r9, [rdi+rdx]
+.block:
+  add r8, 16
+  cmp r8, r9
+  jae .done
+  movdqa xmm0, [r8]
+  pcmpeqb xmm0, xmm1
+  pmovmskb r10d, xmm0
+  test r10d, r10d
+  jz .block
+  bsf r10d, r10d
+  add r10, r8
+  sub r10, rdi
+  cmp r10, rdx
+  cmovb rax, r10
+.done:
+  ret
+.found_first:
+  bsf r10d, r10d
+  cmp r10, rdx
+  cmovb rax, r10
+  ret
+
+; u64 mem_cstr_len(const char *buf), same aligned scan as 'mem_find' looking for the terminator
+mem_cstr_len:
+  cmp byte [mem_avx2], 0
+  je mem_cstr_len_sse2
+  vpxor xmm1, xmm1, xmm1
+  mov r8, rdi
+  and r8, -32
+  vpcmpeqb ymm0, ymm1, [r8]
+  vpmovmskb eax, ymm0
+  mov ecx, edi
+  and ecx, 31
+  shr eax, cl
+  test eax, eax
+  jnz .found_first
+.block:
+  add r8, 32
+  vpcmpeqb ymm0, ymm1, [r8]
+  vpmovmskb eax, ymm0
+  test eax, eax
+  jz .block
+  vzeroupper
+  bsf eax, eax
+  add rax, r8
+  sub rax, rdi
+  ret
+.found_first:
+  vzeroupper
+  bsf eax, eax
+  ret
+
+mem_cstr_len_sse2:
+  pxor xmm1, xmm1
+  mov r8, rdi
+  and r8, -16
+  movdqa xmm0, [r8]
+  pcmpeqb xmm0, xmm1
+  pmovmskb eax, xmm0
+  mov ecx, edi
+  and ecx, 15
+  shr eax, cl
+  test eax, eax
+  jnz .found_first
+.block:
+  add r8, 16
+  movdqa xmm0, [r8]
+  pcmpeqb xmm0, xmm1
+  pmovmskb eax, xmm0
+  test eax, eax
+  jz .block
+  bsf eax, eax
+  add rax, r8
+  sub rax, rdi
+  ret
+.found_first:
+  bsf eax, eax
+  ret
+
+section '.data' writeable
+mem_rep_min dq 2048 ; below this many bytes the vector loops beat 'rep movsb'/'rep stosb'
+mem_avx2    db 0
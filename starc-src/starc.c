@@ -1,23 +1,51 @@
 typedef unsigned long int u64;
+typedef unsigned int u32;
+typedef unsigned char u8;
 #define true 1
 #define false 0
 
 #define is_neg(x) ((x) >= (1ul << 63))
 
 /* system calls */
+#define STDIN  0
 #define STDOUT 1
 #define STDERR 2
 
+#define PROT_NONE 0x0
 #define PROT_READ 0x1
 #define PROT_WRITE 0x2
+#define PROT_EXEC 0x4
 #define MAP_PRIVATE 0x2
 #define MAP_ANONYMOUS 0x20
+#define MAP_NORESERVE 0x4000
+#define MAP_POPULATE 0x8000
 #define MAP_FAILED ((void *) -1)
 
+#define MREMAP_MAYMOVE 1
+#define MREMAP_FIXED   2
+
+#define MADV_SEQUENTIAL 2
+#define MADV_DONTNEED 4
+#define MADV_HUGEPAGE 14
+#define MADV_POPULATE_WRITE 23
+
+#define PAGE_SIZE 4096ul
+#define PAGE_ALIGN(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
 #define O_RDONLY 0x0
 #define O_WRONLY 0x1
 #define O_RDWR   0x2
 #define O_CREAT  0x40
+#define O_TRUNC  0x200
+
+#define MFD_CLOEXEC 0x1
+#define PATH_MAX 4096
+
+#define S_IFMT  0170000
+#define S_IFREG 0100000
 
 #define SYS_READ    0
 #define SYS_WRITE   1
@@ -25,8 +53,23 @@ typedef unsigned long int u64;
 #define SYS_CLOSE   3
 #define SYS_FSTAT   5
 #define SYS_MMAP    9
+#define SYS_MPROTECT 10
 #define SYS_MUNMAP  11
+#define SYS_MREMAP  25
+#define SYS_MADVISE 28
+#define SYS_GETPID  39
+#define SYS_RENAME  82
+#define SYS_MKDIR   83
+#define SYS_UNLINK  87
+#define SYS_DUP2    33
+#define SYS_FORK    57
+#define SYS_EXECVE  59
 #define SYS_EXIT    60
+#define SYS_WAIT4   61
+#define SYS_FUTEX   202
+#define SYS_SCHED_GETAFFINITY 204
+#define SYS_EXIT_GROUP    231
+#define SYS_MEMFD_CREATE  319
 
 struct stat {
   u64 st_dev;
@@ -47,11 +90,27 @@ struct stat {
   u64 __unused[3]; /* should be i64, but for now we don't care */
 };
 
+#define STAT_MODE(st) ((st).__wrong0 & 0xffffffff) /* 'st_mode' is the low half of '__wrong0' */
+
 u64 __syscall__(u64 sys_code, u64 arg0, u64 arg1, u64 arg2, u64 arg3, u64 arg4, u64 arg5);
 
+/* memory primitives, on helper.s. 'mem_init' picks the fastest version the cpu supports */
+void  mem_init(void);
+void *mem_copy(void *dst, const void *src, u64 len);
+void *mem_set(void *dst, u64 c, u64 len);
+u64   mem_eq(const void *s0, const void *s1, u64 len);
+u64   mem_find(const void *buf, u64 c, u64 len); /* index of the first 'c', or 'len' */
+u64   mem_cstr_len(const char *buf);
+
+/* threads and atomics, on helper.s */
+u64 thread_spawn(void *stack_top, void (*fn)(void *), void *arg, volatile u64 *tid);
+u64 atomic_add(volatile u64 *p, u64 value); /* returns what '*p' was before */
+u64 atomic_cas(volatile u64 *p, u64 expected, u64 desired);
+
+/* every thread of the process goes, so an error on a worker doesn't leave the others running */
 void
 exit(u64 exit_code) {
-  (void)__syscall__(SYS_EXIT, exit_code, 0, 0, 0, 0, 0);
+  (void)__syscall__(SYS_EXIT_GROUP, exit_code, 0, 0, 0, 0, 0);
 }
 
 u64
@@ -81,7 +140,8 @@ fstat(u64 fd, struct stat *out) {
 
 void *
 mmap(void *addr, u64 len, u64 prot, u64 flags, u64 fildes, u64 off) {
-  return (void *)__syscall__(SYS_MMAP, (u64)addr, len, prot, flags, fildes, off);
+  u64 res = __syscall__(SYS_MMAP, (u64)addr, len, prot, flags, fildes, off);
+  return is_neg(res) ? MAP_FAILED : (void *)res; /* the kernel returns '-errno', not -1 */
 }
 
 u64
@@ -89,34 +149,309 @@ munmap(void *addr, u64 len) {
   return __syscall__(SYS_MUNMAP, (u64)addr, len, 0, 0, 0, 0);
 }
 
+u64
+mprotect(void *addr, u64 len, u64 prot) {
+  return __syscall__(SYS_MPROTECT, (u64)addr, len, prot, 0, 0, 0);
+}
+
+void *
+mremap(void *old_addr, u64 old_len, u64 new_len, u64 flags, void *new_addr) {
+  return (void *)__syscall__(SYS_MREMAP, (u64)old_addr, old_len, new_len, flags, (u64)new_addr, 0);
+}
+
+u64
+madvise(void *addr, u64 len, u64 advice) {
+  return __syscall__(SYS_MADVISE, (u64)addr, len, advice, 0, 0, 0);
+}
+
+u64
+rename(const char *old_path, const char *new_path) {
+  return __syscall__(SYS_RENAME, (u64)old_path, (u64)new_path, 0, 0, 0, 0);
+}
+
+u64
+unlink(const char *path) {
+  return __syscall__(SYS_UNLINK, (u64)path, 0, 0, 0, 0, 0);
+}
+
+u64
+mkdir(const char *path, u64 mode) {
+  return __syscall__(SYS_MKDIR, (u64)path, mode, 0, 0, 0, 0);
+}
+
+u64
+getpid(void) {
+  return __syscall__(SYS_GETPID, 0, 0, 0, 0, 0, 0);
+}
+
+u64
+dup2(u64 old_fd, u64 new_fd) {
+  return __syscall__(SYS_DUP2, old_fd, new_fd, 0, 0, 0, 0);
+}
+
+u64
+fork(void) {
+  return __syscall__(SYS_FORK, 0, 0, 0, 0, 0, 0);
+}
+
+u64
+execve(const char *path, char **argv, char **envp) {
+  return __syscall__(SYS_EXECVE, (u64)path, (u64)argv, (u64)envp, 0, 0, 0);
+}
+
+u64
+wait4(u64 pid, u64 *status, u64 options) {
+  return __syscall__(SYS_WAIT4, pid, (u64)status, options, 0, 0, 0);
+}
+
+u64
+memfd_create(const char *name, u64 flags) {
+  return __syscall__(SYS_MEMFD_CREATE, (u64)name, flags, 0, 0, 0, 0);
+}
+
+/* only the low 32 bits of 'addr' are the futex. they aren't private futexes, because the kernel's wake for
+ * a cleared thread id never is */
+void
+futex_wait(volatile u64 *addr, u64 value) {
+  (void)__syscall__(SYS_FUTEX, (u64)addr, FUTEX_WAIT, value & 0xffffffff, 0, 0, 0);
+}
+
+void
+futex_wake(volatile u64 *addr) {
+  (void)__syscall__(SYS_FUTEX, (u64)addr, FUTEX_WAKE, 0x7fffffff, 0, 0, 0);
+}
+
 /* tape with arena-only allocator */
+void assert(u64 cond, const char *msg); /* defined along with the default I/O buffer */
+
 struct tape_header {
   u64 len;
   u64 cap;
   u64 typ;
+  u64 flags;
+  u64 top; /* bytes from the header on that may have pages, for 'TAPE_LAZY' it's also what's committed */
+  u64 dirty; /* for 'TAPE_POOLED', bytes from the header on that the tapes the slot held before may have written */
 };
 #define TAPE_HEADER_GET(tape) (((struct tape_header *)tape) - 1)
+#define TAPE_MAP_SIZE(h) PAGE_ALIGN(sizeof (struct tape_header) + (h)->cap)
 
-void *
-tape_make(u64 type_size, u64 capacity) {
+#define TAPE_NORESERVE 0x01 /* no swap reservation for the capacity */
+#define TAPE_LAZY      0x02 /* reserve the capacity as PROT_NONE and commit it as it grows */
+#define TAPE_HUGE      0x04 /* ask for transparent huge pages */
+#define TAPE_POPULATE  0x08 /* prefault the capacity upfront, or each commit for 'TAPE_LAZY' */
+#define TAPE_TRIM      0x10 /* give pages back to the OS on shrink and clear */
+#define TAPE_STATIC    0x20 /* backed by a buffer embedded on the executable */
+#define TAPE_STACK     0x40 /* backed by a buffer provided by the caller, usually on the stack */
+#define TAPE_SHARED    0x80 /* grown by several threads at once with 'tape_grow_shared', see 'tape_make_shared' */
+#define TAPE_POOLED    0x100 /* a slot of 'tape_pool' instead of a mapping of its own */
+#define TAPE_UNPOOLED  0x200 /* a mapping of its own even when it fits on a slot, for 'tape_protect' */
+#define TAPE_DEFAULT   (TAPE_LAZY|TAPE_NORESERVE) /* used for the default capacity */
+/* what a slot of 'tape_pool' gives on its own or honors, tapes with any other flag get a mapping of their own */
+#define TAPE_POOL_FLAGS (TAPE_LAZY|TAPE_NORESERVE|TAPE_TRIM)
+
+#define TAPE_STATIC_DEFAULT_CAP (32ul << 20)
+#define TAPE_STACK_DEFAULT_CAP  (4ul << 10)
+/* declares a buffer for a static or stack tape of 'capacity' bytes */
+#define TAPE_BUFFER(name, capacity) u64 name[(sizeof (struct tape_header) + (capacity) + 7) / 8]
+
+static struct tape_header *
+tape_map(u64 size, u64 flags) {
   struct tape_header *h;
-  if (type_size == 0) type_size = 1;
-  capacity = capacity ? capacity * type_size : 1ul << 32; /* 4GiB of default capacity, practically infinite */
-  h = mmap(0, sizeof (struct tape_header) + capacity, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  u64 map_flags;
+  map_flags = MAP_PRIVATE|MAP_ANONYMOUS;
+  if (flags & TAPE_NORESERVE) map_flags |= MAP_NORESERVE;
+  if ((flags & TAPE_POPULATE) && !(flags & TAPE_LAZY)) map_flags |= MAP_POPULATE;
+  h = mmap(0, size, flags & TAPE_LAZY ? PROT_NONE : PROT_READ|PROT_WRITE, map_flags, -1, 0);
   if (h == MAP_FAILED) return 0;
+  if (flags & TAPE_HUGE) (void)madvise(h, size, MADV_HUGEPAGE); /* only a hint, fine if it fails */
+  if ((flags & TAPE_LAZY) && is_neg(mprotect(h, PAGE_SIZE, PROT_READ|PROT_WRITE))) {
+    (void)munmap(h, size);
+    return 0;
+  }
+  return h;
+}
+
+static void *
+tape_make_mapped(u64 type_size, u64 capacity, u64 flags) {
+  struct tape_header *h;
+  capacity = capacity ? capacity * type_size : 1ul << 32; /* 4GiB of default capacity, practically infinite */
+  h = tape_map(PAGE_ALIGN(sizeof (struct tape_header) + capacity), flags & ~(TAPE_STATIC|TAPE_STACK|TAPE_UNPOOLED));
+  if (!h) return 0;
   h->len = 0;
   h->cap = capacity;
   h->typ = type_size;
+  h->flags = flags;
+  h->top = flags & TAPE_LAZY ? PAGE_SIZE : sizeof (struct tape_header);
+  return h + 1;
+}
+
+/* tape pool, one reservation cut on 'TAPE_POOL_STRIDE' byte slots, each big enough for a tape with the default
+ * capacity. 'tape_make' takes a slot instead of mapping, and 'tape_destroy' gives it back, both without a
+ * syscall and from any thread. the reservation is read and write with no swap reservation, so a slot never
+ * needs a commit and its pages only exist once they're touched, and however many tapes there are it's a single
+ * VMA. a slot that comes back isn't cleared, the tape that takes it next clears it as it grows over it. so a
+ * slot doesn't keep the pages of the biggest tape it ever held, what's past 'TAPE_POOL_KEEP' bytes is given
+ * back to the OS when it comes back. lazy and no swap reservation are what a slot already is, so tapes asking
+ * for them are pooled, and so are 'TAPE_TRIM' ones, which give pages back as they shrink like mapped ones */
+#define TAPE_POOL_STRIDE (1ul << 32)
+#define TAPE_POOL_SLOTS  4096ul /* 16TiB of the 128TiB of user address space */
+#define TAPE_POOL_KEEP   (64ul << 10)
+
+struct tape_pool {
+  u8 *base;
+  volatile u64 fresh; /* slots below it were handed out at least once */
+  volatile u64 free;  /* 'tag << 32 | slot + 1' of the last slot given back, 0 when there's none. a given back
+                       * slot keeps the next one on 'len'. the tag changes with every push and pop, so a pop
+                       * that read a link before another thread took the slot fails its compare and swap */
+};
+
+static struct tape_pool tape_pool;
+
+/* reserves the pool, tapes are mapped on their own before it and once it runs out of slots */
+u64
+tape_pool_init(void) {
+  u8 *base;
+  base = mmap(0, TAPE_POOL_STRIDE * TAPE_POOL_SLOTS, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) return false; /* strict overcommit accounting doesn't take it */
+  tape_pool.fresh = 0;
+  tape_pool.free  = 0;
+  tape_pool.base  = base;
+  return true;
+}
+
+static struct tape_header *
+tape_pool_take(void) {
+  struct tape_header *h;
+  u64 head, slot;
+  if (!tape_pool.base) return 0;
+  for (head = tape_pool.free; head & 0xffffffff; head = tape_pool.free) {
+    h = (struct tape_header *)(tape_pool.base + ((head & 0xffffffff) - 1) * TAPE_POOL_STRIDE);
+    if (atomic_cas(&tape_pool.free, head, ((head >> 32) + 1) << 32 | h->len)) return h;
+  }
+  if (tape_pool.fresh >= TAPE_POOL_SLOTS) return 0;
+  slot = atomic_add(&tape_pool.fresh, 1);
+  if (slot >= TAPE_POOL_SLOTS) return 0;
+  return (struct tape_header *)(tape_pool.base + slot * TAPE_POOL_STRIDE);
+}
+
+static void
+tape_pool_give(struct tape_header *h) {
+  u64 head, slot = ((u8 *)h - tape_pool.base) / TAPE_POOL_STRIDE;
+  if (h->top > h->dirty) h->dirty = h->top;
+  if (h->dirty > TAPE_POOL_KEEP) {
+    /* the pages read as zeroes after this, so they aren't dirty anymore */
+    (void)madvise((u8 *)h + TAPE_POOL_KEEP, PAGE_ALIGN(h->dirty) - TAPE_POOL_KEEP, MADV_DONTNEED);
+    h->dirty = TAPE_POOL_KEEP;
+  }
+  do {
+    head = tape_pool.free;
+    h->len = head & 0xffffffff;
+  } while (!atomic_cas(&tape_pool.free, head, ((head >> 32) + 1) << 32 | (slot + 1)));
+}
+
+/* pooled when it fits on a slot and only asks for 'TAPE_POOL_FLAGS', mapped on its own otherwise */
+void *
+tape_make_with(u64 type_size, u64 capacity, u64 flags) {
+  struct tape_header *h;
+  if (type_size == 0) type_size = 1;
+  if ((flags & ~TAPE_POOL_FLAGS) || capacity * type_size > TAPE_POOL_STRIDE - sizeof (struct tape_header) ||
+      !(h = tape_pool_take())) {
+    return tape_make_mapped(type_size, capacity, flags);
+  }
+  h->len = 0;
+  h->cap = capacity ? capacity * type_size : TAPE_POOL_STRIDE - sizeof (struct tape_header);
+  h->typ = type_size;
+  h->flags = TAPE_POOLED | (flags & TAPE_TRIM);
+  h->top = sizeof (struct tape_header);
+  return h + 1;
+}
+
+void *
+tape_make(u64 type_size, u64 capacity) {
+  return tape_make_with(type_size, capacity, capacity ? 0 : TAPE_DEFAULT);
+}
+
+static void *
+tape_make_on(void *buf, u64 buf_size, u64 type_size, u64 flags) {
+  struct tape_header *h = buf;
+  if (!buf || buf_size <= sizeof (struct tape_header)) return 0;
+  if (type_size == 0) type_size = 1;
+  h->len = 0;
+  h->cap = (buf_size - sizeof (struct tape_header)) / type_size * type_size;
+  h->typ = type_size;
+  h->flags = flags;
+  h->top = buf_size;
   return h + 1;
 }
 
+/* no syscalls, the tape lives on 'buf' which should be declared with 'TAPE_BUFFER' */
+void *
+tape_make_static(void *buf, u64 buf_size, u64 type_size) {
+  return tape_make_on(buf, buf_size, type_size, TAPE_STATIC);
+}
+
+void *
+tape_make_stack(void *buf, u64 buf_size, u64 type_size) {
+  return tape_make_on(buf, buf_size, type_size, TAPE_STACK);
+}
+
+/* makes sure the first 'end' bytes from the header on are usable */
+static u64
+tape_commit(struct tape_header *h, u64 end) {
+  u64 top;
+  if (end <= h->top) return true;
+  if (h->flags & TAPE_POOLED) {
+    /* so it starts zeroed like a fresh mapping, doubling so the clears add up to the size of the tape */
+    top = end < h->top * 2 ? h->top * 2 : end;
+    if (top > TAPE_MAP_SIZE(h)) top = TAPE_MAP_SIZE(h);
+    if (h->top < h->dirty) (void)mem_set((char *)h + h->top, 0, (top < h->dirty ? top : h->dirty) - h->top);
+    h->top = top;
+    return true;
+  }
+  if (!(h->flags & TAPE_LAZY)) {
+    h->top = end;
+    return true;
+  }
+  /* at least double what's committed so growing one element at a time costs a logarithmic amount of syscalls */
+  top = PAGE_ALIGN(end);
+  if (top < h->top * 2) top = h->top * 2;
+  if (top > TAPE_MAP_SIZE(h)) top = TAPE_MAP_SIZE(h);
+  if (is_neg(mprotect((char *)h + h->top, top - h->top, PROT_READ|PROT_WRITE))) return false;
+  if (h->flags & TAPE_POPULATE) (void)madvise((char *)h + h->top, top - h->top, MADV_POPULATE_WRITE);
+  h->top = top;
+  return true;
+}
+
+static void
+tape_trim(struct tape_header *h) {
+  u64 keep, top;
+  if (!(h->flags & TAPE_TRIM) || (h->flags & (TAPE_STATIC|TAPE_STACK))) return;
+  keep = PAGE_ALIGN(sizeof (struct tape_header) + h->len * h->typ);
+  top  = PAGE_ALIGN(h->top);
+  if (keep >= top) return;
+  if (h->flags & TAPE_POOLED) {
+    /* the whole slot is always writable, only the pages go back. they read as zeroes, so they aren't dirty */
+    if (h->dirty <= top) h->dirty = keep;
+    (void)madvise((char *)h + keep, top - keep, MADV_DONTNEED);
+    h->top = keep;
+    return;
+  }
+  /* dropping write access also gives the commit charge back */
+  if (h->flags & TAPE_LAZY) (void)mprotect((char *)h + keep, top - keep, PROT_NONE);
+  (void)madvise((char *)h + keep, top - keep, MADV_DONTNEED);
+  h->top = keep;
+}
+
 void *
 tape_grow_unsafe(void *tape, u64 amount) {
   struct tape_header *h;
   void *out = 0;
+  u64 end;
   if (!tape) return out;
   h = TAPE_HEADER_GET(tape);
   if ((h->len + amount) * h->typ > h->cap) return out;
+  end = sizeof (struct tape_header) + (h->len + amount) * h->typ;
+  if (end > h->top && !tape_commit(h, end)) return out;
   out = (char *)tape + (h->len * h->typ);
   h->len += amount;
   return out;
@@ -129,13 +464,188 @@ tape_shrink(void *tape, u64 amount) {
   h = TAPE_HEADER_GET(tape);
   if (amount > h->len) return false;
   h->len -= amount;
+  tape_trim(h);
+  return true;
+}
+
+/* savepoint of the tape, everything pushed after it can be dropped at once with 'tape_rollback' */
+u64
+tape_mark(const void *tape) {
+  struct tape_header *h;
+  if (!tape) return 0;
+  h = TAPE_HEADER_GET(tape);
+  return h->len;
+}
+
+/* drops everything pushed after 'mark', 'TAPE_TRIM' tapes also give the pages back */
+u64
+tape_rollback(void *tape, u64 mark) {
+  struct tape_header *h;
+  if (!tape) return false;
+  h = TAPE_HEADER_GET(tape);
+  if (mark > h->len) return false;
+  h->len = mark;
+  tape_trim(h);
+  return true;
+}
+
+/* grows the capacity by at least 'amount' elements, the tape might move so every pointer into it dies */
+u64
+tape_grow_cap_kill_ptrs(void **tape, u64 amount) {
+  struct tape_header *h, *n;
+  u64 old_size, new_size, top;
+  if (!tape || !*tape) return false;
+  h = TAPE_HEADER_GET(*tape);
+  assert(!(h->flags & (TAPE_STATIC|TAPE_STACK|TAPE_SHARED)), "'tape_grow_cap_kill_ptrs' used on a static, stack or shared tape");
+  if (h->flags & TAPE_POOLED) {
+    /* a slot can't get bigger, the tape is copied to a mapping of its own */
+    new_size = PAGE_ALIGN(sizeof (struct tape_header) + h->cap + amount * h->typ);
+    n = tape_map(new_size, TAPE_NORESERVE);
+    if (!n) return false;
+    (void)mem_copy(n, h, sizeof (struct tape_header) + h->len * h->typ);
+    n->cap   = new_size - sizeof (struct tape_header);
+    n->flags = TAPE_NORESERVE;
+    tape_pool_give(h);
+    *tape = n + 1;
+    return true;
+  }
+  old_size = TAPE_MAP_SIZE(h);
+  new_size = PAGE_ALIGN(old_size + amount * h->typ);
+  n = tape_map(new_size, h->flags);
+  if (!n) return false;
+  /* move the pages in use to the new reservation instead of copying them */
+  top = PAGE_ALIGN(h->top);
+  if (mremap(h, top, top, MREMAP_MAYMOVE|MREMAP_FIXED, n) != n) {
+    (void)munmap(n, new_size);
+    return false;
+  }
+  if (old_size > top) (void)munmap((char *)h + top, old_size - top);
+  n->cap = new_size - sizeof (struct tape_header);
+  *tape = n + 1;
+  return true;
+}
+
+/* 'tape_grow_unsafe' that grows the capacity instead of failing, classic dynamic array behavior */
+void *
+tape_grow_might_kill_ptrs_unsafe(void **tape, u64 amount) {
+  struct tape_header *h;
+  void *out;
+  u64 grow;
+  if (!tape || !*tape) return 0;
+  out = tape_grow_unsafe(*tape, amount);
+  if (out) return out;
+  h = TAPE_HEADER_GET(*tape);
+  if (h->flags & (TAPE_STATIC|TAPE_STACK)) return 0;
+  grow = h->cap / h->typ; /* at least double */
+  if (grow < amount) grow = amount;
+  if (!tape_grow_cap_kill_ptrs(tape, grow)) return 0;
+  return tape_grow_unsafe(*tape, amount);
+}
+
+/* commits and faults in the first 'amount' elements, so later pushes up to it don't page fault */
+u64
+tape_prefault(void *tape, u64 amount) {
+  struct tape_header *h;
+  u64 end, i;
+  if (!tape) return false;
+  h = TAPE_HEADER_GET(tape);
+  if (amount * h->typ > h->cap) return false;
+  end = sizeof (struct tape_header) + amount * h->typ;
+  if (!tape_commit(h, end)) return false;
+  if (!is_neg(madvise(h, PAGE_ALIGN(end), MADV_POPULATE_WRITE))) return true;
+  /* older kernels don't have MADV_POPULATE_WRITE, touch every page past the header instead */
+  for (i = PAGE_SIZE; i < end; i += PAGE_SIZE) ((char *)h)[i] = 0;
   return true;
 }
 
+/* flips the pages in use to 'prot', 'PROT_READ|PROT_EXEC' turns the tape into code that can be run. the header
+ * shares the first page, so the tape can't change until it's flipped back to 'PROT_READ|PROT_WRITE'. pooled
+ * tapes can't be flipped, their slot goes back to the pool as it is */
+u64
+tape_protect(void *tape, u64 prot) {
+  struct tape_header *h;
+  if (!tape) return false;
+  h = TAPE_HEADER_GET(tape);
+  if (h->flags & (TAPE_STATIC|TAPE_STACK|TAPE_POOLED)) return false;
+  return !is_neg(mprotect(h, PAGE_ALIGN(h->top), prot));
+}
+
+/* tape that several threads grow at once. the whole capacity is mapped read and write upfront, so growing it
+ * never commits anything and the only shared write is one atomic add on 'len'. it still never moves. running out
+ * of capacity is fatal, the amount that didn't fit isn't given back because another thread may already have
+ * its elements after it. shrinking, rollbacks and clears are only for when no thread is growing it */
+void *
+tape_make_shared(u64 type_size, u64 capacity, u64 flags) {
+  struct tape_header *h;
+  void *tape = tape_make_with(type_size, capacity, (flags & ~(TAPE_LAZY|TAPE_STATIC|TAPE_STACK)) | TAPE_SHARED | TAPE_NORESERVE);
+  if (!tape) return 0;
+  h = TAPE_HEADER_GET(tape);
+  h->top = TAPE_MAP_SIZE(h);
+  return tape;
+}
+
+void *
+tape_grow_shared_unsafe(void *tape, u64 amount) {
+  struct tape_header *h;
+  u64 len;
+  if (!tape) return 0;
+  h = TAPE_HEADER_GET(tape);
+  len = atomic_add(&h->len, amount);
+  if ((len + amount) * h->typ > h->cap) return 0;
+  return (char *)tape + len * h->typ;
+}
+
+/* every thread grows a shared tape through a chunk of its own, which takes 'TAPE_CHUNK_SIZE' bytes of the tape
+ * at once and hands them out without atomics, so the threads only meet on the atomic add once per chunk. what's
+ * left of a chunk when it runs out is a hole on the tape, so the elements are found through the pointers or
+ * indices that were handed out instead of by walking the tape */
+#define TAPE_CHUNK_SIZE (64ul << 10)
+
+struct tape_chunk {
+  void *tape;
+  u64 next; /* index of the next element handed out */
+  u64 end;  /* index past the last element of the chunk */
+};
+
+struct tape_chunk
+tape_chunk_make(void *tape) {
+  struct tape_chunk chunk;
+  chunk.tape = tape;
+  chunk.next = 0;
+  chunk.end  = 0;
+  return chunk;
+}
+
+void *
+tape_chunk_grow_unsafe(struct tape_chunk *chunk, u64 amount) {
+  struct tape_header *h;
+  char *out;
+  u64 take;
+  if (!chunk || !chunk->tape) return 0;
+  h = TAPE_HEADER_GET(chunk->tape);
+  if (chunk->end - chunk->next < amount) {
+    take = (TAPE_CHUNK_SIZE + h->typ - 1) / h->typ;
+    if (take < amount) take = amount;
+    out = tape_grow_shared_unsafe(chunk->tape, take);
+    if (!out) return 0;
+    chunk->next = (out - (char *)chunk->tape) / h->typ;
+    chunk->end  = chunk->next + take;
+  }
+  out = (char *)chunk->tape + chunk->next * h->typ;
+  chunk->next += amount;
+  return out;
+}
+
 #define tape_grow(tape, amount, T) ((T *)tape_grow_unsafe(tape, amount))
 #define tape_push_unsafe(tape) tape_grow_unsafe(tape, 1)
 #define tape_push(tape, T) tape_grow(tape, 1, T)
 #define tape_pop(tape) tape_shrink(tape, 1)
+#define tape_grow_might_kill_ptrs(tape, amount, T) ((T *)tape_grow_might_kill_ptrs_unsafe((void **)&(tape), amount))
+#define tape_push_might_kill_ptrs(tape, T) tape_grow_might_kill_ptrs(tape, 1, T)
+#define tape_grow_shared(tape, amount, T) ((T *)tape_grow_shared_unsafe(tape, amount))
+#define tape_push_shared(tape, T) tape_grow_shared(tape, 1, T)
+#define tape_chunk_grow(chunk, amount, T) ((T *)tape_chunk_grow_unsafe(chunk, amount))
+#define tape_chunk_push(chunk, T) tape_chunk_grow(chunk, 1, T)
 
 u64
 tape_len(const void *tape) {
@@ -159,6 +669,7 @@ tape_clear(void *tape) {
   if (!tape) return false;
   h = TAPE_HEADER_GET(tape);
   h->len = 0;
+  tape_trim(h);
   return true;
 }
 
@@ -167,10 +678,16 @@ tape_destroy(void *tape) {
   struct tape_header *h;
   if (!tape) return 0;
   h = TAPE_HEADER_GET(tape);
-  return munmap(h, sizeof (struct tape_header) + h->cap) == 0;
+  if (h->flags & (TAPE_STATIC|TAPE_STACK)) return true;
+  if (h->flags & TAPE_POOLED) {
+    tape_pool_give(h);
+    return true;
+  }
+  return munmap(h, TAPE_MAP_SIZE(h)) == 0;
 }
 
 #undef TAPE_HEADER_GET
+#undef TAPE_MAP_SIZE
 
 /* string */
 struct string {
@@ -183,8 +700,8 @@ u64
 cstring_len(const char *buf) {
   u64 n;
   if (!buf) return 0;
-  for (n = 0; buf[n] && n < CSTRING_MAX; n++);
-  return n;
+  n = mem_cstr_len(buf);
+  return n < CSTRING_MAX ? n : CSTRING_MAX;
 }
 
 struct string
@@ -197,12 +714,10 @@ string_make(const char *buf, u64 len) {
 
 u64
 string_eq(const struct string *s0, const struct string *s1) {
-  u64 i, diff = 0;
   if (!s0 || !s1) return false;
   if (s0->len != s1->len) return false;
   if (s0->len != 0 && (!s0->buf || !s1->buf)) return false;
-  for (i = 0; i < s0->len; i++) diff |= s0->buf[i] ^ s1->buf[i];
-  return diff == 0;
+  return mem_eq(s0->buf, s1->buf, s0->len);
 }
 
 u64
@@ -281,20 +796,21 @@ string_builder_destroy(struct string_builder *builder) {
 
 u64
 string_builder_append(struct string_builder *builder, const struct string *string) {
-  u64 i;
   if (!builder || !builder->buf || !string) return false;
   if (!tape_grow(builder->buf, string->len, char)) return false;
-  for (i = 0; i < string->len; i++) builder->buf[builder->beg + builder->len++] = string->buf[i];
+  (void)mem_copy(builder->buf + builder->beg + builder->len, string->buf, string->len);
+  builder->len += string->len;
   return true;
 }
 
 u64
 string_builder_append_cstr(struct string_builder *builder, const char *buf) {
-  u64 i, len;
+  u64 len;
   if (!builder || !builder->buf || !buf) return false;
   len = cstring_len(buf);
   if (!tape_grow(builder->buf, len, char)) return false;
-  for (i = 0; i < len; i++) builder->buf[builder->beg + builder->len++] = buf[i];
+  (void)mem_copy(builder->buf + builder->beg + builder->len, buf, len);
+  builder->len += len;
   return true;
 }
 
@@ -302,7 +818,7 @@ u64
 string_builder_append_char(struct string_builder *builder, char c) {
   if (!builder || !builder->buf) return false;
   if (!tape_push(builder->buf, char)) return false;
-  builder->buf[builder->len++] = c;
+  builder->buf[builder->beg + builder->len++] = c;
   return true;
 }
 
@@ -346,7 +862,7 @@ u64
 string_builder_clear(struct string_builder *builder) {
   if (!builder || !builder->buf) return false;
   builder->len = 0;
-  return true;
+  return tape_rollback(builder->buf, builder->beg);
 }
 
 u64
@@ -355,6 +871,13 @@ string_builder_print(const struct string_builder *builder) {
   return !is_neg(write(builder->fd, builder->buf + builder->beg, builder->len));;
 }
 
+/* prints and clears, so a builder can stream into 'fd' in chunks */
+u64
+string_builder_flush(struct string_builder *builder) {
+  if (!string_builder_print(builder)) return false;
+  return string_builder_clear(builder);
+}
+
 u64
 string_builder_println(struct string_builder *builder) {
   if (!builder || !builder->buf) return false;
@@ -364,9 +887,10 @@ string_builder_println(struct string_builder *builder) {
 
 /* default I/O buffer */
 static struct string_builder io;
+static TAPE_BUFFER(io_buf, TAPE_STATIC_DEFAULT_CAP);
 void
 io_make(void) {
-  io = string_builder_begin(0);
+  io = string_builder_begin(tape_make_static(io_buf, sizeof (io_buf), sizeof (char)));
   if (!io.buf) exit(1);
 }
 
@@ -442,28 +966,118 @@ struct source {
   struct string file_path;
   struct string data;
   u64 pos;
+  u64 is_mapped; /* 'data.buf' is a private file mapping instead of a tape */
+  u64 *lines;    /* offset of the first byte of every line, 'lines[0]' is always 0 */
+  u64 module;    /* position on the command line */
 };
 
+/* while the modules are lexed and parsed in parallel, 'source_done[i]' is set once module 'i' went through
+ * without errors. it's 0 the rest of the time */
+static volatile u64 *source_done;
+
+#define SOURCE_CHUNK_SIZE (1ul << 16)
+
+static u64
+source_stream_fd(struct source *src, u64 fd) {
+  char *src_buf, *chunk;
+  u64 amount;
+  src_buf = tape_make(sizeof (char), 0);
+  if (!src_buf) return false;
+  do {
+    chunk = tape_grow(src_buf, SOURCE_CHUNK_SIZE, char);
+    if (!chunk) return false;
+    amount = read(fd, chunk, SOURCE_CHUNK_SIZE);
+    if (is_neg(amount)) return false;
+    (void)tape_shrink(src_buf, SOURCE_CHUNK_SIZE - amount);
+  } while (amount);
+  src->data.buf  = src_buf;
+  src->data.len  = tape_len(src_buf);
+  src->is_mapped = false;
+  return true;
+}
+
+static u64
+source_map_fd(struct source *src, u64 fd, u64 size) {
+  void *src_buf;
+  src_buf = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (src_buf == MAP_FAILED) return false;
+  (void)madvise(src_buf, size, MADV_SEQUENTIAL); /* only a hint, fine if it fails */
+  src->data.buf  = src_buf;
+  src->data.len  = size;
+  src->is_mapped = true;
+  return true;
+}
+
+#define SWAR_ONES  0x0101010101010101ul
+#define SWAR_HIGHS 0x8080808080808080ul
+#define SWAR_LOWS  0x7f7f7f7f7f7f7f7ful
+/* sets the high bit of every byte in 'word' equal to 'c', without false positives */
+#define SWAR_MATCH(word, c) (~(((((word) ^ ((c) * SWAR_ONES)) & SWAR_LOWS) + SWAR_LOWS) | ((word) ^ ((c) * SWAR_ONES)) | SWAR_LOWS))
+/* index of the lowest byte with the high bit set, 'mask' must only have high bits set and not be 0 */
+#define SWAR_FIRST(mask) (((((mask) & -(mask)) >> 7) * 0x0001020304050607ul) >> 56)
+
+static u64
+source_push_line(struct source *src, u64 index) {
+  u64 *line = tape_push(src->lines, u64);
+  if (!line) return false;
+  *line = index;
+  return true;
+}
+
+static u64
+source_index_lines(struct source *src) {
+  u64 i, word, mask;
+  src->lines = tape_make(sizeof (u64), 0);
+  if (!src->lines || !source_push_line(src, 0)) return false;
+  /* scan byte by byte until 'i' is aligned, then 8 bytes at a time */
+  for (i = 0; i < src->data.len && ((u64)&src->data.buf[i] & 7); i++) {
+    if (src->data.buf[i] == '\n' && !source_push_line(src, i + 1)) return false;
+  }
+  for (; i + 8 <= src->data.len; i += 8) {
+    word = *(const u64 *)&src->data.buf[i];
+    for (mask = SWAR_MATCH(word, '\n'); mask; mask &= mask - 1) {
+      if (!source_push_line(src, i + SWAR_FIRST(mask) + 1)) return false;
+    }
+  }
+  for (; i < src->data.len; i++) {
+    if (src->data.buf[i] == '\n' && !source_push_line(src, i + 1)) return false;
+  }
+  return true;
+}
+
 struct source
 file_to_source(const char *file_path) {
   struct source src;
-  char *src_buf;
   u64 src_file;
   struct stat src_stat;
-  src_file = open(file_path, O_RDONLY, 0);
+  src_file = file_path[0] == '-' && file_path[1] == '\0' ? STDIN : open(file_path, O_RDONLY, 0);
   assert(!is_neg(src_file), "couldn't open source file");
   assert(!is_neg(fstat(src_file, &src_stat)), "couldn't get file info");
-  src_buf = tape_make(sizeof (char), src_stat.st_size);
-  assert(src_buf != 0, "couldn't make source buffer");
-  assert(read(src_file, src_buf, src_stat.st_size) == src_stat.st_size, "couldn't read source file");
-  assert(!is_neg(close(src_file)), "couldn't close source file");
-  src.data.len = src_stat.st_size;
-  src.data.buf = src_buf;
+  /* regular files are mapped and read in place, pipes, stdin and empty or special files are streamed */
+  if ((STAT_MODE(src_stat) & S_IFMT) != S_IFREG || !src_stat.st_size || !source_map_fd(&src, src_file, src_stat.st_size)) {
+    assert(source_stream_fd(&src, src_file), "couldn't read source file");
+  }
+  if (src_file != STDIN) assert(!is_neg(close(src_file)), "couldn't close source file");
+  assert(source_index_lines(&src), "couldn't index source lines");
   src.file_path = string_make(file_path, 0);
   src.pos = 0;
+  src.module = 0;
   return src;
 }
 
+u64
+source_destroy(struct source *src) {
+  u64 res;
+  if (!src || !src->data.buf) return false;
+  if (src->is_mapped) res = munmap((void *)src->data.buf, src->data.len) == 0;
+  else                res = tape_destroy((void *)src->data.buf);
+  res &= tape_destroy(src->lines);
+  src->data.buf = 0;
+  src->data.len = 0;
+  src->lines = 0;
+  return res;
+}
+
 char
 source_chop(struct source *src) {
   if (!src || !src->data.buf) return '\0';
@@ -488,20 +1102,35 @@ source_rewind(struct source *src) {
 struct source_line { u64 index, number; }
 source_get_line(const struct source *src, u64 index) {
   struct source_line line;
-  u64 i;
-  u64 is_line;
+  u64 lo, hi, mid;
   line.index = 0;
   line.number = 1;
-  if (!src || !src->data.buf || index >= src->data.len) return line;
-  for (i = 0; i < index; i++) {
-    is_line = src->data.buf[i] == '\n';
-    line.number += is_line;
-    line.index   = (is_line)  * (i + 1)   +
-                   (!is_line) * line.index;
+  if (!src || !src->data.buf || !src->lines || index >= src->data.len) return line;
+  /* last line that starts at or before 'index' */
+  lo = 0;
+  hi = tape_len(src->lines);
+  while (hi - lo > 1) {
+    mid = lo + (hi - lo) / 2;
+    if (src->lines[mid] <= index) lo = mid;
+    else                          hi = mid;
   }
+  line.index  = src->lines[lo];
+  line.number = lo + 1;
   return line;
 }
 
+u64
+source_get_line_end(const struct source *src, const struct source_line *line) {
+  if (!src || !src->data.buf || !src->lines || !line) return 0;
+  if (line->number >= tape_len(src->lines)) return src->data.len;
+  return src->lines[line->number] - 1; /* the '\n' of the line */
+}
+
+u64
+source_line_count(const struct source *src) {
+  return tape_len(src->lines);
+}
+
 struct source_position { u64 line, column; }
 source_get_position(const struct source *src, u64 index) {
   struct source_position pos;
@@ -517,6 +1146,17 @@ source_get_position(const struct source *src, u64 index) {
   return pos;
 }
 
+/* an error only goes out once the modules before its own are known to have none, so the one reported is
+ * always the first on command line order, however the threads went. the error that wins exits the process */
+void
+source_error_wait(struct source *src) {
+  u64 i;
+  if (!source_done || !src) return;
+  for (i = 0; i < src->module; i++) {
+    while (!source_done[i]) futex_wait(&source_done[i], 0);
+  }
+}
+
 void
 source_error_location_to_io(struct source *src, struct source_position *pos) {
   if (!src || !src->file_path.buf || !pos) return;
@@ -553,11 +1193,8 @@ source_error_code_snippet_to_io(struct source *src, u64 index, u64 len) {
   io_append(&line_str);
   io_reset();
   line_str.buf = &src->data.buf[index + len];
-  line_str.len = 0;
-  for (i = index + len; i < src->data.len; i++) {
-    if (src->data.buf[i] == '\n') break;
-    line_str.len++;
-  }
+  line_str.len = source_get_line_end(src, &line);
+  line_str.len = line_str.len > index + len ? line_str.len - (index + len) : 0;
   io_append(&line_str);
   io_append_cstr("\n  ");
   for (line_number_digits = line.number == 0; line.number; line.number /= 10) line_number_digits++;
@@ -573,225 +1210,589 @@ source_error_code_snippet_to_io(struct source *src, u64 index, u64 len) {
   io_append_char('\n');
 }
 
-/* lexer */
-enum token_type {
-  TKN_IDEN = 0,
-  TKN_INT,
-  TKN_DEF,
-  TKN_LPAR,
-  TKN_RPAR,
-  TKN_ASSIGN_BOD,
-  TKN_ASSIGN_CON,
-  TKN_ASSIGN_VAR,
-  TKN_SEMICOLON,
-  TKN_COMMA,
-  TKN_SYSCALL
+/* identifier interning */
+struct interner {
+  u64 *slots;           /* open addressing, each slot is 'hash << 32 | id', 0 means empty */
+  struct string *names; /* indexed by id, 'names[SYM_NONE]' is the empty string */
 };
+#define SYM_NONE 0
+#define INTERNER_MIN_SLOTS 1024
 
-#define TOKEN_STRING(str) do { res.buf = str; res.len = sizeof(str) - 1; } while (0)
-struct string
-token_to_string(enum token_type type) {
-  struct string res;
-  res.buf = "Unknown";
-  res.len = 7;
-  switch (type) {
-    case TKN_IDEN:        TOKEN_STRING("Identifier");         break;
-    case TKN_INT:         TOKEN_STRING("Integer");            break;
-    case TKN_DEF:         TOKEN_STRING("Def");                break;
-    case TKN_LPAR:        TOKEN_STRING("Left_Parenthesis");   break;
-    case TKN_RPAR:        TOKEN_STRING("Right_Parenthesis");  break;
-    case TKN_ASSIGN_BOD:  TOKEN_STRING("Assign_Body");        break;
-    case TKN_ASSIGN_CON:  TOKEN_STRING("Assign_Constant");    break;
-    case TKN_ASSIGN_VAR:  TOKEN_STRING("Assign_Variable");    break;
-    case TKN_SEMICOLON:   TOKEN_STRING("Semicolon");          break;
-    case TKN_COMMA:       TOKEN_STRING("Comma");              break;
-    case TKN_SYSCALL:     TOKEN_STRING("Syscall");            break;
+/* 64 bit hash of 'len' bytes, the steps of xxh64 for its tail. every step rotates the state, so the high bits
+ * of a word reach the low ones before the next word goes in, and the finalizer spreads every bit over all of
+ * them. it keys the caches on disk, so it has to be more than just fast */
+#define HASH_P1 0x9e3779b185ebca87ul
+#define HASH_P2 0xc2b2ae3d27d4eb4ful
+#define HASH_P3 0x165667b19e3779f9ul
+#define HASH_P4 0x85ebca77c2b2ae63ul
+#define HASH_P5 0x27d4eb2f165667c5ul
+#define HASH_ROTL(x, r) ((x) << (r) | (x) >> (64 - (r)))
+
+static u64
+hash_bytes(const char *buf, u64 len) {
+  u64 i, h, k;
+  h = HASH_P5 + len;
+  for (i = 0; i + 8 <= len; i += 8) {
+    k  = *(const u64 *)&buf[i] * HASH_P2;
+    h ^= HASH_ROTL(k, 31) * HASH_P1;
+    h  = HASH_ROTL(h, 27) * HASH_P1 + HASH_P4;
+  }
+  if (i + 4 <= len) {
+    h ^= (*(const u32 *)&buf[i] & 0xfffffffful) * HASH_P1;
+    h  = HASH_ROTL(h, 23) * HASH_P2 + HASH_P3;
+    i += 4;
+  }
+  for (; i < len; i++) {
+    h ^= (buf[i] & 0xff) * HASH_P5;
+    h  = HASH_ROTL(h, 11) * HASH_P1;
+  }
+  h ^= h >> 33;
+  h *= HASH_P2;
+  h ^= h >> 29;
+  h *= HASH_P3;
+  h ^= h >> 32;
+  return h;
+}
+#undef HASH_ROTL
+
+static u64
+intern_hash(const struct string *s) {
+  return (hash_bytes(s->buf, s->len) & 0xffffffff) | 1; /* never 0 so a used slot is never empty */
+}
+
+static void
+interner_place(u64 *slots, u64 hash, u64 id) {
+  u64 mask, i;
+  mask = tape_len(slots) - 1;
+  for (i = hash & mask; slots[i]; i = (i + 1) & mask);
+  slots[i] = hash << 32 | id;
+}
+
+static u64
+interner_rehash(struct interner *interner, u64 slot_amount) {
+  u64 *slots, id;
+  slots = tape_make(sizeof (u64), slot_amount);
+  if (!slots || !tape_grow(slots, slot_amount, u64)) return false;
+  for (id = SYM_NONE + 1; id < tape_len(interner->names); id++) {
+    interner_place(slots, intern_hash(&interner->names[id]), id);
+  }
+  if (interner->slots) (void)tape_destroy(interner->slots);
+  interner->slots = slots;
+  return true;
+}
+
+struct interner
+interner_make(void) {
+  struct interner interner;
+  struct string *none;
+  interner.slots = 0;
+  interner.names = tape_make(sizeof (struct string), 0);
+  assert(interner.names != 0, "couldn't make interner names buffer");
+  none = tape_push(interner.names, struct string);
+  none->buf = "";
+  none->len = 0;
+  assert(interner_rehash(&interner, INTERNER_MIN_SLOTS), "couldn't make interner slots buffer");
+  return interner;
+}
+
+/* returns the dense id of 's', the same bytes always get the same id */
+u64
+interner_intern(struct interner *interner, const struct string *s) {
+  u64 hash, mask, i, id;
+  struct string *name;
+  hash = intern_hash(s);
+  mask = tape_len(interner->slots) - 1;
+  for (i = hash & mask; interner->slots[i]; i = (i + 1) & mask) {
+    if (interner->slots[i] >> 32 != hash) continue;
+    id = interner->slots[i] & 0xffffffff;
+    name = &interner->names[id];
+    if (name->len == s->len && mem_eq(name->buf, s->buf, s->len)) return id;
+  }
+  id = tape_len(interner->names);
+  assert(id <= 0xffffffff, "exceeded maximum interned identifier amount");
+  name = tape_push(interner->names, struct string);
+  assert(name != 0, "exceeded maximum interned identifier amount");
+  *name = *s;
+  /* keep the load factor under 1/2 */
+  if (id * 2 >= tape_len(interner->slots)) {
+    assert(interner_rehash(interner, tape_len(interner->slots) * 2), "couldn't grow interner slots buffer");
+  } else {
+    interner->slots[i] = hash << 32 | id;
+  }
+  return id;
+}
+
+const struct string *
+interner_name(const struct interner *interner, u64 id) {
+  if (!interner || !interner->names || id >= tape_len(interner->names)) return 0;
+  return &interner->names[id];
+}
+
+u64
+interner_destroy(struct interner *interner) {
+  u64 res;
+  if (!interner || !interner->names) return false;
+  res  = tape_destroy(interner->slots);
+  res &= tape_destroy(interner->names);
+  interner->slots = 0;
+  interner->names = 0;
+  return res;
+}
+
+/* lexer */
+enum token_type {
+  TKN_IDEN = 0,
+  TKN_INT,
+  TKN_DEF,
+  TKN_LPAR,
+  TKN_RPAR,
+  TKN_ASSIGN_BOD,
+  TKN_ASSIGN_CON,
+  TKN_ASSIGN_VAR,
+  TKN_SEMICOLON,
+  TKN_COMMA,
+  TKN_SYSCALL,
+  TKN_ADD,
+  TKN_SUB,
+  TKN_MUL,
+  TKN_DIV,
+  TKN_SHL,
+  TKN_SHR,
+  TKN_BIT_AND,
+  TKN_BIT_OR,
+  TKN_EOF
+};
+
+#define TOKEN_STRING(str) do { res.buf = str; res.len = sizeof(str) - 1; } while (0)
+struct string
+token_to_string(enum token_type type) {
+  struct string res;
+  res.buf = "Unknown";
+  res.len = 7;
+  switch (type) {
+    case TKN_IDEN:        TOKEN_STRING("Identifier");         break;
+    case TKN_INT:         TOKEN_STRING("Integer");            break;
+    case TKN_DEF:         TOKEN_STRING("Def");                break;
+    case TKN_LPAR:        TOKEN_STRING("Left_Parenthesis");   break;
+    case TKN_RPAR:        TOKEN_STRING("Right_Parenthesis");  break;
+    case TKN_ASSIGN_BOD:  TOKEN_STRING("Assign_Body");        break;
+    case TKN_ASSIGN_CON:  TOKEN_STRING("Assign_Constant");    break;
+    case TKN_ASSIGN_VAR:  TOKEN_STRING("Assign_Variable");    break;
+    case TKN_SEMICOLON:   TOKEN_STRING("Semicolon");          break;
+    case TKN_COMMA:       TOKEN_STRING("Comma");              break;
+    case TKN_SYSCALL:     TOKEN_STRING("Syscall");            break;
+    case TKN_ADD:         TOKEN_STRING("Add");                break;
+    case TKN_SUB:         TOKEN_STRING("Subtract");           break;
+    case TKN_MUL:         TOKEN_STRING("Multiply");           break;
+    case TKN_DIV:         TOKEN_STRING("Divide");             break;
+    case TKN_SHL:         TOKEN_STRING("Shift_Left");         break;
+    case TKN_SHR:         TOKEN_STRING("Shift_Right");        break;
+    case TKN_BIT_AND:     TOKEN_STRING("Bitwise_And");        break;
+    case TKN_BIT_OR:      TOKEN_STRING("Bitwise_Or");         break;
+    case TKN_EOF:         TOKEN_STRING("End_Of_File");        break;
   }
   return res;
 }
 #undef TOKEN_STRING
 
+/* decoded view of a token on the stream, made on demand by 'lexer_token' */
 struct token {
   enum token_type type;
+  u32 sym; /* interned id for identifiers, 'SYM_NONE' otherwise */
   struct string data;
+  u64 index; /* position on the stream, the end of file token is one past the last token */
 };
 
-enum lexer_state {
-  LEXER_NORMAL = 0,
-  LEXER_IDEN,
-  LEXER_INT,
-  LEXER_COMMENT
-};
-
+/* the token stream is stored as parallel tapes, 9 bytes per token */
 struct lexer {
-  struct token *tokens;
+  u8  *kinds;   /* 'enum token_type' of every token */
+  u32 *offsets; /* offset of the first byte of every token on the source */
+  u32 *values;  /* interned id for identifiers, length for integers, index of the matching ')' for '(',
+                 * top-level comma amount of the group for ')' and 0 for the other fixed length tokens */
   struct source *src;
+  struct interner *names;
   u64 pos;
 };
 
+#define CHR_DELIM 1
+#define CHR_IDEN  2 /* can start an identifier */
+#define CHR_DIGIT 4
+static const char lexer_char_class[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0,
+  0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 2,
+  0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+#define CHR_CLASS(c) lexer_char_class[(c) & 0xff]
+
+/* high bit of every byte >= 'c', only exact for ascii bytes */
+#define SWAR_GE(word, c) (((word) + (0x80 - (c)) * SWAR_ONES) & SWAR_HIGHS)
+#define SWAR_RANGE(word, lo, hi) (SWAR_GE(word, lo) & ~SWAR_GE(word, (hi) + 1))
+
+/* high bit of every byte of 'word' that belongs to 'cls'.
+ * non-ascii bytes are never part of a class, carries out of them only reach bytes after the first mismatch */
 static u64
-is_delimiter(char c) {
-  return c == ' ' || c == '\t' || c == '\n';
+lexer_class_mask(u64 word, u64 cls) {
+  u64 mask = 0;
+  if (cls & CHR_DELIM) mask |= SWAR_MATCH(word, ' ') | SWAR_MATCH(word, '\t') | SWAR_MATCH(word, '\n');
+  if (cls & CHR_IDEN)  mask |= SWAR_RANGE(word, 'a', 'z') | SWAR_RANGE(word, 'A', 'Z') | SWAR_MATCH(word, '_');
+  if (cls & CHR_DIGIT) mask |= SWAR_RANGE(word, '0', '9');
+  return mask & ~word & SWAR_HIGHS;
 }
 
+/* index of the first byte at or after 'i' that isn't on 'cls' */
 static u64
-is_identifier_start(char c) {
-  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+lexer_skip_class(const char *buf, u64 i, u64 len, u64 cls) {
+  u64 mask;
+  for (; i + 8 <= len; i += 8) {
+    mask = lexer_class_mask(*(const u64 *)&buf[i], cls);
+    if (mask != SWAR_HIGHS) return i + SWAR_FIRST(~mask & SWAR_HIGHS);
+  }
+  while (i < len && (CHR_CLASS(buf[i]) & cls)) i++;
+  return i;
 }
 
+/* index of the '\n' that ends the comment, or 'len' */
 static u64
-is_number(char c) {
-  return c >= '0' && c <= '9';
+lexer_skip_comment(const char *buf, u64 i, u64 len) {
+  return i + mem_find(buf + i, '\n', len - i);
 }
 
+/* perfect hash over the first, second and last bytes plus the length. every keyword of the spec has a 'case',
+ * so a collision shows up as a duplicated 'case' at compile time. the ones the parser doesn't handle yet are
+ * still identifiers, they're there so the multipliers stay checked against the whole set */
+#define KEYWORD_HASH(c0, c1, cn, len) (((c0) + (c1) + (cn) * 3 + (len) * 2) & 63)
 #define RETURN_KEYWORD(keyword_string, keyword_type) do { \
-  keyword = string_make(keyword_string, 0); \
-  if (string_eq(tok_data, &keyword)) return keyword_type; \
+  if (tok_data->len != sizeof (keyword_string) - 1) return TKN_IDEN; \
+  if (!mem_eq(tok_data->buf, keyword_string, tok_data->len)) return TKN_IDEN; \
+  return keyword_type; \
 } while (0)
 static enum token_type
 token_type_from_identifier(const struct string *tok_data) {
-  struct string keyword;
-  RETURN_KEYWORD("def", TKN_DEF);
-  RETURN_KEYWORD("__syscall__", TKN_SYSCALL);
+  if (tok_data->len < 2) return TKN_IDEN;
+  switch (KEYWORD_HASH(tok_data->buf[0], tok_data->buf[1], tok_data->buf[tok_data->len - 1], tok_data->len)) {
+    case KEYWORD_HASH('d', 'e', 'f',  3): RETURN_KEYWORD("def",         TKN_DEF);
+    case KEYWORD_HASH('_', '_', '_', 11): RETURN_KEYWORD("__syscall__", TKN_SYSCALL);
+    case KEYWORD_HASH('f', 'n', 'n',  2): RETURN_KEYWORD("fn",          TKN_IDEN);
+    case KEYWORD_HASH('i', 'f', 'f',  2): RETURN_KEYWORD("if",          TKN_IDEN);
+    case KEYWORD_HASH('e', 'l', 'e',  4): RETURN_KEYWORD("else",        TKN_IDEN);
+    case KEYWORD_HASH('w', 'h', 'e',  5): RETURN_KEYWORD("while",       TKN_IDEN);
+    case KEYWORD_HASH('r', 'e', 't',  3): RETURN_KEYWORD("ret",         TKN_IDEN);
+    case KEYWORD_HASH('b', 'r', 'k',  3): RETURN_KEYWORD("brk",         TKN_IDEN);
+    case KEYWORD_HASH('p', 'u', 'b',  3): RETURN_KEYWORD("pub",         TKN_IDEN);
+    case KEYWORD_HASH('p', 'r', 'v',  3): RETURN_KEYWORD("prv",         TKN_IDEN);
+    case KEYWORD_HASH('i', 'n', 'c',  3): RETURN_KEYWORD("inc",         TKN_IDEN);
+    case KEYWORD_HASH('i', 'n', 'j',  6): RETURN_KEYWORD("incobj",      TKN_IDEN);
+    case KEYWORD_HASH('e', 'x', 'm',  6): RETURN_KEYWORD("extsym",      TKN_IDEN);
+    case KEYWORD_HASH('m', 'o', 'd',  3): RETURN_KEYWORD("mod",         TKN_IDEN);
+    case KEYWORD_HASH('m', 'u', 't',  3): RETURN_KEYWORD("mut",         TKN_IDEN);
+    case KEYWORD_HASH('i', 'm', 'm',  3): RETURN_KEYWORD("imm",         TKN_IDEN);
+    case KEYWORD_HASH('s', 't', 't',  6): RETURN_KEYWORD("struct",      TKN_IDEN);
+    case KEYWORD_HASH('d', 'e', 'r',  5): RETURN_KEYWORD("defer",       TKN_IDEN);
+    case KEYWORD_HASH('n', 'u', 'l',  4): RETURN_KEYWORD("null",        TKN_IDEN);
+    case KEYWORD_HASH('t', 'r', 'e',  4): RETURN_KEYWORD("true",        TKN_IDEN);
+    case KEYWORD_HASH('f', 'a', 'e',  5): RETURN_KEYWORD("false",       TKN_IDEN);
+    case KEYWORD_HASH('t', 'r', 's',  5): RETURN_KEYWORD("trans",       TKN_IDEN);
+    case KEYWORD_HASH('r', 'e', 'e',  6): RETURN_KEYWORD("renege",      TKN_IDEN);
+    case KEYWORD_HASH('n', 'o', 't',  5): RETURN_KEYWORD("noret",       TKN_IDEN);
+    case KEYWORD_HASH('t', 'y', 'm',  7): RETURN_KEYWORD("typefam",     TKN_IDEN);
+  }
   return TKN_IDEN;
 }
+#undef KEYWORD_HASH
 #undef RETURN_KEYWORD
 
+static void
+lexer_error_begin(struct source *src, u64 index) {
+  struct source_position pos;
+  source_error_wait(src);
+  pos = source_get_position(src, index);
+  io.fd = STDERR;
+  io_clear();
+  source_error_location_to_io(src, &pos);
+}
+
+static void
+lexer_error_end(struct source *src, u64 index, u64 len) {
+  io_append_char('\n');
+  source_error_code_snippet_to_io(src, index, len);
+  io_print();
+  exit(1);
+}
+
+static void
+lexer_unbalanced_error(struct source *src, u64 index, char found, char missing, const char *what) {
+  lexer_error_begin(src, index);
+  io_append_char('\'');
+  io_set_bold_white();
+  io_append_char(found);
+  io_reset();
+  io_append_cstr(what);
+  io_set_bold_white();
+  io_append_char(missing);
+  io_reset();
+  io_append_char('\'');
+  lexer_error_end(src, index, 1);
+}
+
 #define NEW_TOKEN(tok_type) do { \
-  tok = tape_push(lexer.tokens, struct token); \
-  assert(tok != 0, "exceeded maximum token capacity"); \
-  tok->type = tok_type; \
-  tok->data = tok_data; \
+  kind   = tape_push(lexer.kinds,   u8); \
+  offset = tape_push(lexer.offsets, u32); \
+  value  = tape_push(lexer.values,  u32); \
+  assert(kind && offset && value, "exceeded maximum token capacity"); \
+  *kind   = tok_type; \
+  *offset = tok_data.buf - buf; \
+  *value  = *kind == TKN_IDEN ? interner_intern(names, &tok_data) : *kind == TKN_INT ? tok_data.len : 0; \
 } while (0)
 
 struct lexer
-source_to_lexer(struct source *src) {
-  char c;
-  enum lexer_state state;
+source_to_lexer(struct source *src, struct interner *names) {
+  const char *buf;
+  u64 i, len, cls;
   struct string tok_data;
   struct lexer lexer;
-  struct token *tok;
-  lexer.tokens = tape_make(sizeof (struct token), 0);
-  assert(lexer.tokens != 0, "couldn't make tokens buffer");
-  state = LEXER_NORMAL;
-  while ((c = source_chop(src))) {
-    switch (state) {
-      case LEXER_NORMAL: {
-        if (is_delimiter(c)) continue;
-        tok_data.buf = &src->data.buf[src->pos - 1];
-        tok_data.len = 1;
-        if (is_identifier_start(c)) {
-          state = LEXER_IDEN;
-          continue;
-        }
-        if (is_number(c)) {
-          state = LEXER_INT;
-          continue;
-        }
-        switch (c) {
-          case '#':
-            state = LEXER_COMMENT;
-            continue;
-            break;
-          case '(':
-            NEW_TOKEN(TKN_LPAR);
-            break;
-          case ')':
-            NEW_TOKEN(TKN_RPAR);
-            break;
-          case ',':
-            NEW_TOKEN(TKN_COMMA);
-            break;
-          case ';':
-            NEW_TOKEN(TKN_SEMICOLON);
-            break;
-          case ':':
-            NEW_TOKEN(TKN_ASSIGN_CON);
-            break;
-          case '=': {
-            if (source_peek(src, 0) == '>') {
-              (void)source_chop(src);
-              tok_data.len++;
-              NEW_TOKEN(TKN_ASSIGN_BOD);
-            } else {
-              NEW_TOKEN(TKN_ASSIGN_VAR);
-            }
-          } break;
-          default: {
-            u64 symbol_index = src->pos ? src->pos - 1 : 0;
-            struct source_position pos = source_get_position(src, symbol_index);
-            io.fd = STDERR;
-            io_clear();
-            source_error_location_to_io(src, &pos);
-            io_append_cstr("unknown symbol '");
-            io_set_bold_white();
-            io_append_char(c);
-            io_reset();
-            io_append_cstr("'\n");
-            source_error_code_snippet_to_io(src, symbol_index, 1);
-            io_print();
-            exit(1);
-          } break;
-        }
-      } break;
-      case LEXER_IDEN: {
-        if (is_identifier_start(c) || is_number(c)) {
+  u8 *kind;
+  u32 *offset, *value;
+  u64 *groups, *group; /* open '(', each one is 'token index << 32 | top-level comma amount' */
+  TAPE_BUFFER(groups_buf, TAPE_STACK_DEFAULT_CAP * 8);
+  assert(src->data.len <= 0xffffffff, "source file is too large");
+  /* a token is at least one byte, so the source length is a hard limit */
+  lexer.kinds   = tape_make(sizeof (u8),  src->data.len + 1);
+  lexer.offsets = tape_make(sizeof (u32), src->data.len + 1);
+  lexer.values  = tape_make(sizeof (u32), src->data.len + 1);
+  assert(lexer.kinds && lexer.offsets && lexer.values, "couldn't make tokens buffer");
+  groups = tape_make_stack(groups_buf, sizeof (groups_buf), sizeof (u64));
+  assert(groups != 0, "couldn't make parenthesis stack buffer");
+  buf = src->data.buf;
+  len = src->data.len;
+  i = src->pos;
+  while (i < len) {
+    cls = CHR_CLASS(buf[i]);
+    if (cls & CHR_DELIM) {
+      i = lexer_skip_class(buf, i + 1, len, CHR_DELIM);
+      continue;
+    }
+    tok_data.buf = &buf[i];
+    if (cls & CHR_IDEN) {
+      i = lexer_skip_class(buf, i + 1, len, CHR_IDEN|CHR_DIGIT);
+      tok_data.len = &buf[i] - tok_data.buf;
+      NEW_TOKEN(token_type_from_identifier(&tok_data));
+      continue;
+    }
+    if (cls & CHR_DIGIT) {
+      i = lexer_skip_class(buf, i + 1, len, CHR_DIGIT);
+      tok_data.len = &buf[i] - tok_data.buf;
+      NEW_TOKEN(TKN_INT);
+      continue;
+    }
+    tok_data.len = 1;
+    switch (buf[i]) {
+      case '#':
+        i = lexer_skip_comment(buf, i + 1, len);
+        continue;
+        break;
+      case '(':
+        NEW_TOKEN(TKN_LPAR);
+        group = tape_push(groups, u64);
+        assert(group != 0, "exceeded maximum parenthesis nesting");
+        *group = (tape_len(lexer.kinds) - 1) << 32;
+        break;
+      case ')':
+        if (!tape_len(groups)) lexer_unbalanced_error(src, i, ')', '(', "' without opening '");
+        NEW_TOKEN(TKN_RPAR);
+        group = &groups[tape_len(groups) - 1];
+        lexer.values[*group >> 32] = tape_len(lexer.kinds) - 1;
+        *value = *group & 0xffffffff;
+        (void)tape_pop(groups);
+        break;
+      case ',':
+        NEW_TOKEN(TKN_COMMA);
+        if (tape_len(groups)) groups[tape_len(groups) - 1]++;
+        break;
+      case ';':
+        NEW_TOKEN(TKN_SEMICOLON);
+        break;
+      case ':':
+        NEW_TOKEN(TKN_ASSIGN_CON);
+        break;
+      case '=': {
+        if (i + 1 < len && buf[i + 1] == '>') {
           tok_data.len++;
-          if (source_peek(src, 0) != '\0') continue;
+          NEW_TOKEN(TKN_ASSIGN_BOD);
+        } else {
+          NEW_TOKEN(TKN_ASSIGN_VAR);
         }
-        NEW_TOKEN(token_type_from_identifier(&tok_data));
-        state = LEXER_NORMAL;
-        source_rewind(src);
       } break;
-      case LEXER_INT: {
-        if (is_number(c)) {
+      case '+':
+        NEW_TOKEN(TKN_ADD);
+        break;
+      case '-':
+        NEW_TOKEN(TKN_SUB);
+        break;
+      case '*':
+        NEW_TOKEN(TKN_MUL);
+        break;
+      case '/':
+        NEW_TOKEN(TKN_DIV);
+        break;
+      case '&':
+        NEW_TOKEN(TKN_BIT_AND);
+        break;
+      case '|':
+        NEW_TOKEN(TKN_BIT_OR);
+        break;
+      case '<':
+      case '>': {
+        if (i + 1 < len && buf[i + 1] == buf[i]) {
           tok_data.len++;
-          if (source_peek(src, 0) != '\0') continue;
+          NEW_TOKEN(buf[i] == '<' ? TKN_SHL : TKN_SHR);
+          break;
         }
-        NEW_TOKEN(TKN_INT);
-        state = LEXER_NORMAL;
-        source_rewind(src);
+      } /* fallthrough */
+      default: {
+        lexer_error_begin(src, i);
+        io_append_cstr("unknown symbol '");
+        io_set_bold_white();
+        io_append_char(buf[i]);
+        io_reset();
+        io_append_char('\'');
+        lexer_error_end(src, i, 1);
       } break;
-      case LEXER_COMMENT: {
-        if (c == '\n') state = LEXER_NORMAL;
-      }
     }
+    i += tok_data.len;
+  }
+  if (tape_len(groups)) {
+    i = lexer.offsets[groups[tape_len(groups) - 1] >> 32];
+    lexer_unbalanced_error(src, i, '(', ')', "' without closing '");
   }
+  (void)tape_destroy(groups);
+  src->pos = len;
   lexer.pos = 0;
   lexer.src = src;
+  lexer.names = names;
   return lexer;
 }
 #undef NEW_TOKEN
+#undef CHR_CLASS
+
+u64
+lexer_destroy(struct lexer *lexer) {
+  u64 res;
+  if (!lexer || !lexer->kinds) return false;
+  res  = tape_destroy(lexer->kinds);
+  res &= tape_destroy(lexer->offsets);
+  res &= tape_destroy(lexer->values);
+  lexer->kinds   = 0;
+  lexer->offsets = 0;
+  lexer->values  = 0;
+  lexer->pos = 0;
+  return res;
+}
+
+u64
+lexer_len(const struct lexer *lexer) {
+  if (!lexer) return 0;
+  return tape_len(lexer->kinds);
+}
+
+/* index of the ')' that closes the '(' at 'lpar' */
+u64
+lexer_group_end(const struct lexer *lexer, u64 lpar) {
+  if (!lexer || !lexer->kinds || lpar >= tape_len(lexer->kinds) || lexer->kinds[lpar] != TKN_LPAR) return lexer_len(lexer);
+  return lexer->values[lpar];
+}
+
+/* amount of commas directly inside the '(' at 'lpar', not counting nested groups */
+u64
+lexer_group_commas(const struct lexer *lexer, u64 lpar) {
+  u64 rpar = lexer_group_end(lexer, lpar);
+  if (rpar >= lexer_len(lexer)) return 0;
+  return lexer->values[rpar];
+}
+
+static u64
+token_fixed_len(enum token_type type) {
+  switch (type) {
+    case TKN_DEF:        return 3;
+    case TKN_SYSCALL:    return 11;
+    case TKN_ASSIGN_BOD: return 2;
+    case TKN_SHL:        return 2;
+    case TKN_SHR:        return 2;
+    case TKN_EOF:        return 0;
+    default:             return 1;
+  }
+}
+
+struct token
+lexer_token(const struct lexer *lexer, u64 index) {
+  struct token tok;
+  tok.index = index;
+  tok.sym   = SYM_NONE;
+  if (!lexer || !lexer->kinds || index >= tape_len(lexer->kinds)) {
+    tok.index = lexer_len(lexer);
+    tok.type  = TKN_EOF;
+    tok.data.buf = lexer && lexer->src ? lexer->src->data.buf + lexer->src->data.len : 0;
+    tok.data.len = 0;
+    return tok;
+  }
+  tok.type = lexer->kinds[index];
+  tok.data.buf = lexer->src->data.buf + lexer->offsets[index];
+  if (tok.type == TKN_IDEN) {
+    tok.sym = lexer->values[index];
+    tok.data.len = lexer->names->names[tok.sym].len;
+  } else if (tok.type == TKN_INT) {
+    tok.data.len = lexer->values[index];
+  } else {
+    tok.data.len = token_fixed_len(tok.type);
+  }
+  return tok;
+}
 
-struct token *
+struct token
 lexer_chop(struct lexer *lexer) {
-  if (!lexer || !lexer->tokens) return 0;
-  if (lexer->pos >= tape_len(lexer->tokens)) return 0;
-  return &lexer->tokens[lexer->pos++];
+  struct token tok = lexer_token(lexer, lexer ? lexer->pos : 0);
+  if (tok.type != TKN_EOF) lexer->pos++;
+  return tok;
 }
 
-struct token *
+struct token
 lexer_peek(const struct lexer *lexer, u64 offset) {
-  if (!lexer || !lexer->tokens) return 0;
-  if (lexer->pos + offset >= tape_len(lexer->tokens)) return 0;
-  return &lexer->tokens[lexer->pos + offset];
+  return lexer_token(lexer, lexer ? lexer->pos + offset : 0);
 }
 
 void
 lexer_rewind(struct lexer *lexer) {
-  if (!lexer || !lexer->tokens) return;
+  if (!lexer || !lexer->kinds) return;
   if (lexer->pos == 0) return;
   lexer->pos--;
 }
 
 struct source_position
 token_get_position(const struct source *src, const struct token *tok) {
-  if (!src || !src->data.buf || !tok || !tok->data.buf || tok->data.buf < src->data.buf || tok->data.buf >= src->data.buf + src->data.len) {
-    struct source_position pos;
+  struct source_position pos;
+  if (!src || !src->data.buf || !tok || !tok->data.buf || tok->data.buf < src->data.buf || tok->data.buf > src->data.buf + src->data.len || !src->data.len) {
     pos.line = 1;
     pos.column = 1;
     return pos;
   }
+  if (tok->type == TKN_EOF) {
+    /* just after the last byte */
+    pos = source_get_position(src, src->data.len - 1);
+    pos.column++;
+    return pos;
+  }
   return source_get_position(src, (u64)(tok->data.buf - src->data.buf));
 }
 
@@ -802,9 +1803,10 @@ token_error_code_snippet_to_io(struct source *src, const struct token *tok) {
 }
 
 void
-token_error_begin(struct lexer *lexer, struct token *tok) {
+token_error_begin(struct lexer *lexer, const struct token *tok) {
   struct source_position pos;
-  if (!lexer || lexer->pos >= tape_len(lexer->tokens)) return;
+  if (!lexer || !tok) return;
+  source_error_wait(lexer->src);
   pos = token_get_position(lexer->src, tok);
   io.fd = STDERR;
   io_clear();
@@ -812,8 +1814,8 @@ token_error_begin(struct lexer *lexer, struct token *tok) {
 }
 
 void
-token_error_end(struct lexer *lexer, struct token *tok) {
-  if (!lexer || lexer->pos >= tape_len(lexer->tokens)) return;
+token_error_end(struct lexer *lexer, const struct token *tok) {
+  if (!lexer || !tok) return;
   io_append_char('\n');
   token_error_code_snippet_to_io(lexer->src, tok);
   io_print();
@@ -832,106 +1834,175 @@ enum ast_type {
   AST_FN,
   AST_PARAM,
   AST_CALL,
+  AST_SYSCALL,
+  AST_BINARY,
   AST_STRUCT
 };
 
-struct ast_node;
-struct ast_node_slice {
-  struct ast_node **nodes;
-  u64 len;
-};
-
-struct ast_node {
-  enum ast_type type;
-  union {
-    struct { struct ast_node **children;                                                  } root;
-    struct { struct string value;                                                         } iden;
-    struct { u64 value;                                                                   } int_lit;
-    struct { struct string name; struct ast_node *value;                                  } def;
-    struct { struct ast_node *value;                                                      } group;
-    struct { struct ast_node *body; struct ast_node_slice params; struct string ret_type; } fn;
-    struct { struct string name, type;                                                    } param;
-    struct { struct string name; struct ast_node_slice arg_list;                          } call;
-  } data;
+/* the AST is stored as parallel tapes indexed by node. node 0 is always the root, so 0 also means 'no node'.
+ * there are no pointers, so it can be written out and mapped back as is.
+ *
+ *   kind       token        lhs                    rhs
+ *   AST_ROOT   -            extra: children list   -
+ *   AST_IDEN   identifier   symbol                 -
+ *   AST_INT    integer      extra: low, high       -
+ *   AST_DEF_*  name         symbol                 value
+ *   AST_GROUP  '('          value                  -
+ *   AST_FN     '('          extra: ret, params     body, 'ret' is the return type token, the params list follows it
+ *   AST_PARAM  name         symbol                 type token
+ *   AST_CALL   name         symbol                 extra: arguments list
+ *   AST_SYSCALL '__syscall__' -                     extra: arguments list
+ *   AST_BINARY operator     left operand           right operand
+ *
+ * lists on 'extra' are their length followed by the node indices */
+struct ast {
+  u8  *kinds;  /* 'enum ast_type' of every node */
+  u32 *tokens; /* main token of every node, names and positions come from it */
+  u32 *lhs;
+  u32 *rhs;
+  u32 *extra;
 };
+#define AST_NO_TOKEN 0xffffffff
 
 struct parser {
-  struct ast_node *ast;
-  struct ast_node **node_refs;
+  struct ast ast;
   struct lexer *lexer;
+  u64 prv_node;
 };
 
-struct ast_node *
-parser_node_make(struct parser *parser, enum ast_type type) {
-  struct ast_node *node;
-  if (!parser || !parser->ast) return 0;
-  node = tape_push(parser->ast, struct ast_node);
-  assert(node != 0, "exceeded maximum AST capacity");
-  node->type = type;
-  return node;
+u64
+ast_len(const struct ast *ast) {
+  if (!ast) return 0;
+  return tape_len(ast->kinds);
 }
 
-struct ast_node_slice
-parser_node_slice_make(struct parser *parser, u64 amount) {
-  struct ast_node_slice slice;
-  if (!parser || !parser->ast) {
-    slice.nodes = 0;
-    slice.len = 0;
-    return slice;
-  }
-  slice.nodes = tape_grow(parser->node_refs, amount, struct ast_node *);
-  assert(slice.nodes != 0, "exceeded maximum AST node references capacity");
-  slice.len = amount;
-  return slice;
+u64
+ast_list_len(const struct ast *ast, u64 list) {
+  return ast->extra[list];
+}
+
+u64
+ast_list_get(const struct ast *ast, u64 list, u64 index) {
+  return ast->extra[list + 1 + index];
+}
+
+u64
+ast_int_value(const struct ast *ast, u64 node) {
+  return (u64)ast->extra[ast->lhs[node] + 1] << 32 | ast->extra[ast->lhs[node]];
+}
+
+u64
+ast_fn_ret_token(const struct ast *ast, u64 node) {
+  return ast->extra[ast->lhs[node]];
+}
+
+u64
+ast_fn_params(const struct ast *ast, u64 node) {
+  return ast->lhs[node] + 1;
+}
+
+u64
+ast_destroy(struct ast *ast) {
+  u64 res;
+  if (!ast || !ast->kinds) return false;
+  res  = tape_destroy(ast->kinds);
+  res &= tape_destroy(ast->tokens);
+  res &= tape_destroy(ast->lhs);
+  res &= tape_destroy(ast->rhs);
+  res &= tape_destroy(ast->extra);
+  ast->kinds  = 0;
+  ast->tokens = 0;
+  ast->lhs    = 0;
+  ast->rhs    = 0;
+  ast->extra  = 0;
+  return res;
+}
+
+u64
+parser_node_make(struct parser *parser, enum ast_type type, u64 token) {
+  u8 *kind;
+  u32 *tok, *lhs, *rhs;
+  kind = tape_push(parser->ast.kinds,  u8);
+  tok  = tape_push(parser->ast.tokens, u32);
+  lhs  = tape_push(parser->ast.lhs,    u32);
+  rhs  = tape_push(parser->ast.rhs,    u32);
+  assert(kind && tok && lhs && rhs, "exceeded maximum AST capacity");
+  *kind = type;
+  *tok  = token;
+  *lhs  = 0;
+  *rhs  = 0;
+  return tape_len(parser->ast.kinds) - 1;
+}
+
+/* reserves 'amount' u32 on 'extra' and returns the index of the first one */
+u64
+parser_extra_make(struct parser *parser, u64 amount) {
+  u32 *extra;
+  extra = tape_grow(parser->ast.extra, amount, u32);
+  assert(extra != 0, "exceeded maximum AST extra data capacity");
+  return tape_len(parser->ast.extra) - amount;
+}
+
+/* a list with room for 'amount' nodes, returns the index of its length */
+u64
+parser_list_make(struct parser *parser, u64 amount) {
+  u64 list;
+  list = parser_extra_make(parser, 1 + amount);
+  parser->ast.extra[list] = amount;
+  (void)mem_set(&parser->ast.extra[list + 1], 0, amount * sizeof (u32));
+  return list;
 }
 
-u64 parse_expression(struct parser *parser, struct ast_node **output, u64 is_part_of_expression);
+u64 parse_expression(struct parser *parser, u64 *output, u64 is_part_of_expression);
 
-struct ast_node *
-parse_identifier(struct parser *parser, struct token *tok) {
-  struct ast_node *node;
-  node = parser_node_make(parser, AST_IDEN);
-  node->data.iden.value = tok->data;
+u64
+parse_identifier(struct parser *parser, const struct token *tok) {
+  u64 node;
+  node = parser_node_make(parser, AST_IDEN, tok->index);
+  parser->ast.lhs[node] = tok->sym;
   return node;
 }
 
-struct ast_node *
-parse_integer_literal(struct parser *parser, struct token *tok) {
-  struct ast_node *node;
+u64
+parse_integer_literal(struct parser *parser, const struct token *tok) {
+  u64 node, value;
   struct stu64_result int_val;
-  node = parser_node_make(parser, AST_INT);
+  node = parser_node_make(parser, AST_INT, tok->index);
   int_val = string_to_u64(&tok->data);
   if (int_val.err) {
     token_error_begin(parser->lexer, tok);
     io_append_cstr("integer literal is too large");
     token_error_end(parser->lexer, tok);
   }
-  node->data.int_lit.value = int_val.val;
+  value = parser_extra_make(parser, 2);
+  parser->ast.extra[value]     = int_val.val & 0xffffffff;
+  parser->ast.extra[value + 1] = int_val.val >> 32;
+  parser->ast.lhs[node] = value;
   return node;
 }
 
-struct ast_node *
+u64
 parse_symbol_definition(struct parser *parser, u64 *res) {
-  struct ast_node *node;
-  struct token *iden, *assign;
+  u64 node, value;
+  struct token iden, assign;
   iden = lexer_chop(parser->lexer);
-  if (!iden) {
-    token_error_begin(parser->lexer, iden);
+  if (iden.type == TKN_EOF) {
+    token_error_begin(parser->lexer, &iden);
     io_append_cstr("expected identifier, but found end of file");
-    token_error_end(parser->lexer, iden);
+    token_error_end(parser->lexer, &iden);
   }
-  if (iden->type != TKN_IDEN) {
-    token_error_begin(parser->lexer, iden);
+  if (iden.type != TKN_IDEN) {
+    token_error_begin(parser->lexer, &iden);
     io_append_cstr("expected identifier, but found '");
     io_set_bold_white();
-    io_append(&iden->data);
+    io_append(&iden.data);
     io_reset();
     io_append_char('\'');
-    token_error_end(parser->lexer, iden);
+    token_error_end(parser->lexer, &iden);
   }
   assign = lexer_chop(parser->lexer);
-  if (!assign) {
-    token_error_begin(parser->lexer, assign);
+  if (assign.type == TKN_EOF) {
+    token_error_begin(parser->lexer, &assign);
     io_append_cstr("expected '");
     io_set_bold_white();
     io_append_char(':');
@@ -941,14 +2012,14 @@ parse_symbol_definition(struct parser *parser, u64 *res) {
     io_append_char('=');
     io_reset();
     io_append_cstr("', but found end of file");
-    token_error_end(parser->lexer, assign);
+    token_error_end(parser->lexer, &assign);
   }
-  if (assign->type == TKN_ASSIGN_CON) {
-    node = parser_node_make(parser, AST_DEF_CON);
-  } else if (assign->type == TKN_ASSIGN_VAR) {
-    node = parser_node_make(parser, AST_DEF_VAR);
+  if (assign.type == TKN_ASSIGN_CON) {
+    node = parser_node_make(parser, AST_DEF_CON, iden.index);
+  } else if (assign.type == TKN_ASSIGN_VAR) {
+    node = parser_node_make(parser, AST_DEF_VAR, iden.index);
   } else {
-    token_error_begin(parser->lexer, assign);
+    token_error_begin(parser->lexer, &assign);
     io_append_cstr("expected '");
     io_set_bold_white();
     io_append_char(':');
@@ -959,26 +2030,28 @@ parse_symbol_definition(struct parser *parser, u64 *res) {
     io_reset();
     io_append_cstr("', but found '");
     io_set_bold_white();
-    io_append(&assign->data);
+    io_append(&assign.data);
     io_reset();
     io_append_char('\'');
-    token_error_end(parser->lexer, assign);
+    token_error_end(parser->lexer, &assign);
   }
-  node->data.def.name = iden->data;
-  *res = parse_expression(parser, &node->data.def.value, true);
+  parser->ast.lhs[node] = iden.sym;
+  *res = parse_expression(parser, &value, true);
+  parser->ast.rhs[node] = value;
   return node;
 }
 
-struct ast_node *
-parse_expression_group(struct parser *parser, struct token *rpar, u64 *res) {
-  struct ast_node *node;
-  struct token *next;
-  node = parser_node_make(parser, AST_GROUP);
-  *res = parse_expression(parser, &node->data.group.value, true);
+u64
+parse_expression_group(struct parser *parser, const struct token *lpar, const struct token *rpar, u64 *res) {
+  u64 node, value;
+  struct token next;
+  node = parser_node_make(parser, AST_GROUP, lpar->index);
+  *res = parse_expression(parser, &value, true);
+  parser->ast.lhs[node] = value;
   next = lexer_chop(parser->lexer);
-  assert(next != 0, "'parse_expression' has some wrong logic somewhere");
-  if (next != rpar) {
-    token_error_begin(parser->lexer, next);
+  assert(next.type != TKN_EOF, "'parse_expression' has some wrong logic somewhere");
+  if (next.index != rpar->index) {
+    token_error_begin(parser->lexer, &next);
     io_append_cstr("expected '");
     io_append_char('\'');
     io_set_bold_white();
@@ -986,303 +2059,357 @@ parse_expression_group(struct parser *parser, struct token *rpar, u64 *res) {
     io_reset();
     io_append_cstr("', but found '");
     io_set_bold_white();
-    io_append(&next->data);
+    io_append(&next.data);
     io_reset();
     io_append_char('\'');
-    token_error_end(parser->lexer, next);
+    token_error_end(parser->lexer, &next);
   }
   return node;
 }
 
-struct ast_node *
-parse_function(struct parser *parser, u64 *res, u64 member_amount) {
-  struct ast_node *node;
-  struct token *next;
-  node = parser_node_make(parser, AST_FN);
+u64
+parse_function(struct parser *parser, const struct token *lpar, u64 *res, u64 member_amount) {
+  u64 node, ret, params, body;
+  struct token next;
+  node = parser_node_make(parser, AST_FN, lpar->index);
+  ret    = parser_extra_make(parser, 1);
+  params = parser_list_make(parser, member_amount);
+  parser->ast.lhs[node] = ret;
+  parser->ast.extra[ret] = AST_NO_TOKEN;
   if (member_amount) {
-    struct token *param_tkn;
-    struct ast_node *param;
-    u64 param_idx;
-    node->data.fn.params = parser_node_slice_make(parser, member_amount);
+    struct token param_tkn, untyped_tkn;
+    u64 param, param_idx, untyped;
+    untyped = 0;
     for (param_idx = 0; param_idx < member_amount; param_idx++) {
       param_tkn = lexer_chop(parser->lexer);
-      if (param_tkn->type == TKN_RPAR) break;
-      if (param_tkn->type != TKN_IDEN) {
-        token_error_begin(parser->lexer, param_tkn);
+      if (param_tkn.type == TKN_RPAR) break;
+      if (param_tkn.type != TKN_IDEN) {
+        token_error_begin(parser->lexer, &param_tkn);
         io_append_cstr("expected parameter name, but found '");
         io_set_bold_white();
-        io_append(&next->data);
+        io_append(&param_tkn.data);
         io_reset();
         io_append_char('\'');
-        token_error_end(parser->lexer, param_tkn);
+        token_error_end(parser->lexer, &param_tkn);
       }
-      param = parser_node_make(parser, AST_PARAM);
-      param->data.param.name = param_tkn->data;
+      param = parser_node_make(parser, AST_PARAM, param_tkn.index);
+      parser->ast.lhs[param] = param_tkn.sym;
       next = lexer_chop(parser->lexer);
-      if (next->type == TKN_ASSIGN_VAR) {
+      if (next.type == TKN_ASSIGN_VAR) {
         next = lexer_chop(parser->lexer);
-        if (next->type != TKN_IDEN) {
-          token_error_begin(parser->lexer, next);
+        if (next.type != TKN_IDEN) {
+          token_error_begin(parser->lexer, &next);
           io_append_cstr("expected parameter type, but found '");
           io_set_bold_white();
-          io_append(&next->data);
+          io_append(&next.data);
           io_reset();
           io_append_char('\'');
-          token_error_end(parser->lexer, next);
+          token_error_end(parser->lexer, &next);
+        }
+        parser->ast.rhs[param] = next.index;
+        for (; untyped; untyped--) {
+          parser->ast.rhs[ast_list_get(&parser->ast, params, param_idx - untyped)] = next.index;
         }
-        param->data.param.type = next->data;
         next = lexer_chop(parser->lexer);
-        if (next->type != TKN_COMMA) {
-          if (next->type != TKN_RPAR) {
-            token_error_begin(parser->lexer, next);
+        if (next.type != TKN_COMMA) {
+          if (next.type != TKN_RPAR) {
+            token_error_begin(parser->lexer, &next);
             io_append_cstr("expected '");
             io_set_bold_white();
             io_append_char(')');
             io_reset();
             io_append_cstr("', but found '");
             io_set_bold_white();
-            io_append(&next->data);
+            io_append(&next.data);
             io_reset();
             io_append_char('\'');
-            token_error_end(parser->lexer, next);
-          }
-        }
-      } else if (next->type == TKN_COMMA) {
-        u64 i;
-        for (i = 0; ; i++) {
-          next = lexer_peek(parser->lexer, i);
-          if (next->type == TKN_ASSIGN_VAR) {
-            next = lexer_peek(parser->lexer, i);
-            /* don't need to check if 'next' is an identifier
-               * it will cause an error on a future parameter parsing iteration if it isn't */
-            param->data.param.type = next->data; 
-            break;
-          }
-          if (next->type == TKN_RPAR) {
-            token_error_begin(parser->lexer, param_tkn);
-            io_append_cstr("parameter without a type");
-            token_error_end(parser->lexer, param_tkn);
+            token_error_end(parser->lexer, &next);
           }
         }
+      } else if (next.type == TKN_COMMA) {
+        /* takes the type of the next typed parameter, it's filled when that one is parsed */
+        if (!untyped) untyped_tkn = param_tkn;
+        untyped++;
       } else {
-        token_error_begin(parser->lexer, param_tkn);
+        token_error_begin(parser->lexer, &param_tkn);
         io_append_cstr("parameter without a type");
-        token_error_end(parser->lexer, param_tkn);
+        token_error_end(parser->lexer, &param_tkn);
       }
-      node->data.fn.params.nodes[param_idx] = param;
+      parser->ast.extra[params + 1 + param_idx] = param;
     }
+    if (untyped) {
+      token_error_begin(parser->lexer, &untyped_tkn);
+      io_append_cstr("parameter without a type");
+      token_error_end(parser->lexer, &untyped_tkn);
+    }
+    parser->ast.extra[params] = param_idx; /* a trailing comma isn't a parameter */
   } else {
-    node->data.fn.params.len = 0;
     next = lexer_chop(parser->lexer);
-    if (next->type != TKN_RPAR) { 
-      token_error_begin(parser->lexer, next);
+    if (next.type == TKN_COMMA) next = lexer_chop(parser->lexer); /* '(,)' */
+    if (next.type != TKN_RPAR) { 
+      token_error_begin(parser->lexer, &next);
       io_append_cstr("expected '");
       io_set_bold_white();
       io_append_char(')');
       io_reset();
       io_append_cstr("', but found '");
       io_set_bold_white();
-      io_append(&next->data);
+      io_append(&next.data);
       io_reset();
       io_append_char('\'');
-      token_error_end(parser->lexer, next);
+      token_error_end(parser->lexer, &next);
     }
   }
   next = lexer_chop(parser->lexer);
-  if (next) {
-    if (next->type == TKN_IDEN) {
-      node->data.fn.ret_type = next->data;
+  if (next.type != TKN_EOF) {
+    if (next.type == TKN_IDEN) {
+      parser->ast.extra[ret] = next.index;
       next = lexer_chop(parser->lexer);
-    } else {
-      node->data.fn.ret_type.len = 0;
     }
-    if (next->type != TKN_ASSIGN_BOD) {
-      token_error_begin(parser->lexer, next);
+    if (next.type != TKN_ASSIGN_BOD) {
+      token_error_begin(parser->lexer, &next);
       io_append_cstr("expected '");
       io_set_bold_white();
       io_append_cstr("=>");
       io_reset();
       io_append_cstr("' but found '");
       io_set_bold_white();
-      io_append(&next->data);
+      io_append(&next.data);
       io_reset();
       io_append_char('\'');
-      token_error_end(parser->lexer, next);
+      token_error_end(parser->lexer, &next);
     }
-    *res = parse_expression(parser, &node->data.fn.body, true);
+    *res = parse_expression(parser, &body, true);
+    parser->ast.rhs[node] = body;
   }
   return node;
 }
 
-struct ast_node *
-parse_function_call(struct parser *parser, u64 *res, u64 member_amount) {
-  struct ast_node *node;
-  struct string name;
-  name = parser->prv_node->data.iden.value;
-  node = parser->prv_node;
-  node->type = AST_CALL;
-  node->data.call.name = name;
-  if (member_amount) {
-    struct token *next;
-    u64 arg_idx;
-    node->data.call.arg_list = parser_node_slice_make(parser, member_amount);
-    for (arg_idx = 0; arg_idx < member_amount; arg_idx++) {
-      if (!parse_expression(parser, &node->data.call.arg_list.nodes[arg_idx], true)) {
-        *res = false;
-        return 0;
-      }
-      next = lexer_chop(parser->lexer);
-      if (next->type != TKN_COMMA) {
-        token_error_begin(parser->lexer, next);
-        io_append_cstr("expected '");
-        io_set_bold_white();
-        io_append_char(',');
-        io_reset();
-        io_append_cstr("' but found '");
-        io_set_bold_white();
-        io_append(&next->data);
-        io_reset();
-        io_append_char('\'');
-        token_error_end(parser->lexer, next);
-      }
+u64
+parse_function_call(struct parser *parser, u64 node, const struct token *lpar, const struct token *rpar, u64 *res) {
+  u64 args, arg, arg_idx, member_amount;
+  struct token next;
+  /* the trailing comma is optional, so there's at most one argument more than commas */
+  member_amount = lexer_group_commas(parser->lexer, lpar->index) + 1;
+  /* an identifier node becomes the call, it keeps its token and symbol */
+  if (parser->ast.kinds[node] == AST_IDEN) parser->ast.kinds[node] = AST_CALL;
+  args = parser_list_make(parser, member_amount);
+  parser->ast.rhs[node] = args;
+  next = lexer_peek(parser->lexer, 0);
+  for (arg_idx = 0; next.index != rpar->index; arg_idx++) {
+    assert(arg_idx < member_amount, "'parse_function_call' has some wrong logic somewhere");
+    if (!parse_expression(parser, &arg, true)) {
+      *res = false;
+      return 0;
     }
-  } else {
-    node->data.call.arg_list.len = 0;
-  }
-  return node;
-}
-
-struct ast_node *
-parse_parenthesis(struct parser *parser, struct token *tok, u64 *res, u64 *is_part_of_expression) {
-  struct ast_node *node;
-  struct token *rpar;
-  struct token *next;
-  enum ast_type type;
-  u64 rpar_offset, skip_rpar, member_amount;
-  skip_rpar = false;
-  member_amount = 0;
-  for (rpar_offset = 0; ; rpar_offset++) {
-    rpar = lexer_peek(parser->lexer, rpar_offset);
-    if (!rpar) {
-      token_error_begin(parser->lexer, tok);
-      io_append_char('\'');
+    parser->ast.extra[args + 1 + arg_idx] = arg;
+    next = lexer_chop(parser->lexer);
+    if (next.index == rpar->index) {
+      arg_idx++;
+      break;
+    }
+    if (next.type != TKN_COMMA) {
+      token_error_begin(parser->lexer, &next);
+      io_append_cstr("expected '");
       io_set_bold_white();
-      io_append_char('(');
+      io_append_char(',');
       io_reset();
-      io_append_cstr("' without closing '");
+      io_append_cstr("' or '");
       io_set_bold_white();
       io_append_char(')');
       io_reset();
+      io_append_cstr("' but found '");
+      io_set_bold_white();
+      io_append(&next.data);
+      io_reset();
       io_append_char('\'');
-      token_error_end(parser->lexer, tok);
-    }
-    if (rpar->type == TKN_LPAR) {
-      skip_rpar = true;
-    } else if (rpar->type == TKN_RPAR) {
-      if (skip_rpar) skip_rpar = false;
-      else break;
-    } else if (rpar->type == TKN_COMMA && !skip_rpar) {
-      member_amount++;
+      token_error_end(parser->lexer, &next);
     }
+    next = lexer_peek(parser->lexer, 0);
   }
+  if (parser->lexer->pos == rpar->index) (void)lexer_chop(parser->lexer);
+  parser->ast.extra[args] = arg_idx;
+  return node;
+}
+
+u64
+parse_parenthesis(struct parser *parser, const struct token *tok, u64 *res) {
+  u64 node, callee, is_fn;
+  struct token rpar;
+  struct token next;
+  enum ast_type type;
+  u64 rpar_offset, member_amount;
+  /* the lexer already matched every '(' and counted its commas */
+  rpar = lexer_token(parser->lexer, lexer_group_end(parser->lexer, tok->index));
+  rpar_offset = rpar.index - parser->lexer->pos;
+  member_amount = lexer_group_commas(parser->lexer, tok->index);
+  /* a function literal is a parenthesis followed by '=>', optionally with the return type between them */
+  next = lexer_peek(parser->lexer, rpar_offset + 1);
+  is_fn = next.type == TKN_ASSIGN_BOD || (next.type == TKN_IDEN && lexer_peek(parser->lexer, rpar_offset + 2).type == TKN_ASSIGN_BOD);
+  /* 'prv_node' is only set for the parenthesis right after a callee, nested ones must not see it */
+  callee = parser->prv_node;
+  parser->prv_node = 0;
   type = AST_GROUP;
   next = lexer_peek(parser->lexer, 0);
-  if (parser->prv_node) {
-    io_clear();
-    io_append_u64(parser->prv_node->type);
-    io_println();
-  }
-  if (parser->prv_node && parser->prv_node->type == AST_IDEN) {
+  if (callee && (parser->ast.kinds[callee] == AST_IDEN || parser->ast.kinds[callee] == AST_SYSCALL)) {
     type = AST_CALL;
-    member_amount += next != rpar;
-  } else if (next->type == TKN_IDEN) {
+  } else if (next.type == TKN_IDEN) {
     member_amount++;
     next = lexer_peek(parser->lexer, 1);
-    if (next->type == TKN_ASSIGN_VAR || next->type == TKN_COMMA) {
-      type = AST_STRUCT;
-      next = lexer_peek(parser->lexer, rpar_offset + 1);
-      if (next) {
-        if (next->type == TKN_ASSIGN_BOD) {
-          type = AST_FN;
-        } else if (next->type == TKN_IDEN) {
-          next = lexer_peek(parser->lexer, rpar_offset + 2);
-          if (next && next->type == TKN_ASSIGN_BOD) type = AST_FN;
-        }
-      }
-    }
-  } else if (next == rpar) {
-    next = lexer_peek(parser->lexer, 1);
-    if (next && next->type == TKN_ASSIGN_BOD) type = AST_FN;
+    if (next.type == TKN_ASSIGN_VAR || next.type == TKN_COMMA) type = is_fn ? AST_FN : AST_STRUCT;
+  } else if (next.index == rpar.index || (next.type == TKN_COMMA && next.index + 1 == rpar.index)) {
+    member_amount = 0;
+    if (is_fn) type = AST_FN;
   }
   if (type == AST_GROUP) {
-    node = parse_expression_group(parser, rpar, res);
+    node = parse_expression_group(parser, tok, &rpar, res);
   } else if (type == AST_FN) {
-    node = parse_function(parser, res, member_amount);
+    node = parse_function(parser, tok, res, member_amount);
   } else if (type == AST_CALL) {
-    *is_part_of_expression = true;
-    node = parse_function_call(parser, res, member_amount);
+    node = parse_function_call(parser, callee, tok, &rpar, res);
   } else if (type == AST_STRUCT) {
     assert(0, "structs aren't handled yet");
+    node = 0;
   } else {
     assert(0, "parse_parenthesis: unreachable");
+    node = 0;
   }
   return node;
 }
 
 u64
-parse_expression(struct parser *parser, struct ast_node **output, u64 is_part_of_expression) {
-  u64 res;
-  struct ast_node *node;
-  struct token *tok;
-  tok = lexer_chop(parser->lexer);
-  if (!parser->lexer || !parser || !output || !tok) return false;
-  res = true;
-  switch (tok->type) {
+parse_primary(struct parser *parser, struct token tok, u64 *res) {
+  u64 node;
+  switch (tok.type) {
     case TKN_IDEN: {
-      node = parse_identifier(parser, tok);
+      node = parse_identifier(parser, &tok);
+      if (lexer_peek(parser->lexer, 0).type == TKN_LPAR) {
+        tok = lexer_chop(parser->lexer);
+        parser->prv_node = node;
+        node = parse_parenthesis(parser, &tok, res);
+      }
+    } break;
+    case TKN_SYSCALL: {
+      node = parser_node_make(parser, AST_SYSCALL, tok.index);
+      tok = lexer_chop(parser->lexer);
+      if (tok.type != TKN_LPAR) {
+        token_error_begin(parser->lexer, &tok);
+        io_append_cstr("expected '");
+        io_set_bold_white();
+        io_append_char('(');
+        io_reset();
+        io_append_cstr("' after '");
+        io_set_bold_white();
+        io_append_cstr("__syscall__");
+        io_reset();
+        io_append_char('\'');
+        token_error_end(parser->lexer, &tok);
+      }
+      parser->prv_node = node;
+      node = parse_parenthesis(parser, &tok, res);
     } break;
     case TKN_INT: {
-      node = parse_integer_literal(parser, tok);
+      node = parse_integer_literal(parser, &tok);
     } break;
     case TKN_DEF: {
-      node = parse_symbol_definition(parser, &res);
+      node = parse_symbol_definition(parser, res);
     } break;
     case TKN_LPAR: {
-      node = parse_parenthesis(parser, tok, &res, &is_part_of_expression);
+      node = parse_parenthesis(parser, &tok, res);
     } break;
     default: {
-      token_error_begin(parser->lexer, tok);
+      token_error_begin(parser->lexer, &tok);
       io_append_char('\'');
       io_set_bold_white();
-      io_append(&tok->data);
+      io_append(&tok.data);
       io_reset();
       io_append_cstr("' isn't a valid expression start");
-      token_error_end(parser->lexer, tok);
+      token_error_end(parser->lexer, &tok);
+      node = 0;
     } break;
   }
+  return node;
+}
+
+/* binding power of a binary operator, 0 when 'type' isn't one */
+static u64
+binary_precedence(enum token_type type) {
+  switch (type) {
+    case TKN_MUL:
+    case TKN_DIV:     return 5;
+    case TKN_ADD:
+    case TKN_SUB:     return 4;
+    case TKN_SHL:
+    case TKN_SHR:     return 3;
+    case TKN_BIT_AND: return 2;
+    case TKN_BIT_OR:  return 1;
+    default:          return 0;
+  }
+}
+
+/* precedence climbing over the operators after 'lhs', all of them are left associative */
+u64
+parse_binary(struct parser *parser, u64 lhs, u64 min_precedence, u64 *res) {
+  u64 node, rhs, precedence;
+  struct token op, tok;
+  for (;;) {
+    op = lexer_peek(parser->lexer, 0);
+    precedence = binary_precedence(op.type);
+    if (!precedence || precedence < min_precedence) return lhs;
+    (void)lexer_chop(parser->lexer);
+    tok = lexer_chop(parser->lexer);
+    if (tok.type == TKN_EOF) {
+      token_error_begin(parser->lexer, &tok);
+      io_append_cstr("expected expression after '");
+      io_set_bold_white();
+      io_append(&op.data);
+      io_reset();
+      io_append_cstr("', but found end of file");
+      token_error_end(parser->lexer, &tok);
+    }
+    rhs = parse_primary(parser, tok, res);
+    while (binary_precedence(lexer_peek(parser->lexer, 0).type) > precedence) {
+      rhs = parse_binary(parser, rhs, precedence + 1, res);
+    }
+    node = parser_node_make(parser, AST_BINARY, op.index);
+    parser->ast.lhs[node] = lhs;
+    parser->ast.rhs[node] = rhs;
+    lhs = node;
+  }
+}
+
+u64
+parse_expression(struct parser *parser, u64 *output, u64 is_part_of_expression) {
+  u64 res, node;
+  struct token tok;
+  tok = lexer_chop(parser->lexer);
+  if (!parser->lexer || !parser || !output || tok.type == TKN_EOF) return false;
+  res = true;
+  node = parse_primary(parser, tok, &res);
+  node = parse_binary(parser, node, 1, &res);
   if (!is_part_of_expression) {
-    struct token *semicolon = lexer_chop(parser->lexer);
-    if (!semicolon) {
-      token_error_begin(parser->lexer, semicolon);
+    struct token semicolon = lexer_chop(parser->lexer);
+    if (semicolon.type == TKN_EOF) {
+      token_error_begin(parser->lexer, &semicolon);
       io_append_cstr("expected '");
       io_set_bold_white();
       io_append_char(';');
       io_reset();
       io_append_cstr("', but found end of file");
-      token_error_end(parser->lexer, semicolon);
+      token_error_end(parser->lexer, &semicolon);
     }
-    if (semicolon->type != TKN_SEMICOLON) {
-      token_error_begin(parser->lexer, semicolon);
+    if (semicolon.type != TKN_SEMICOLON) {
+      token_error_begin(parser->lexer, &semicolon);
       io_append_cstr("expected '");
       io_set_bold_white();
       io_append_char(';');
       io_reset();
       io_append_cstr("', but found '");
       io_set_bold_white();
-      io_append(&semicolon->data);
+      io_append(&semicolon.data);
       io_reset();
       io_append_char('\'');
-      token_error_end(parser->lexer, semicolon);
+      token_error_end(parser->lexer, &semicolon);
     }
   }
   *output = node;
@@ -1292,51 +2419,2693 @@ parse_expression(struct parser *parser, struct ast_node **output, u64 is_part_of
 struct parser
 lexer_to_parser(struct lexer *lexer) {
   struct parser parser;
-  struct ast_node *root, **next;
+  u64 root, child, children_list;
+  u32 *children, *next;
   parser.lexer = lexer;
-  parser.ast = tape_make(sizeof (struct ast_node), 0);
-  assert(parser.ast != 0, "couldn't allocate enough memory for the AST");
-  parser.node_refs = tape_make(sizeof (struct ast_node *), 0);
-  assert(parser.ast != 0, "couldn't allocate enough memory for the AST");
-  root = parser_node_make(&parser, AST_ROOT);
-  root->data.root.children = tape_make(sizeof (struct ast_node *), 0);
-  assert(root->data.root.children != 0, "couldn't allocate enough memory for the AST root node");
-  do {
-    next = tape_push(root->data.root.children, struct ast_node *);
+  parser.prv_node = 0;
+  parser.ast.kinds  = tape_make(sizeof (u8),  0);
+  parser.ast.tokens = tape_make(sizeof (u32), 0);
+  parser.ast.lhs    = tape_make(sizeof (u32), 0);
+  parser.ast.rhs    = tape_make(sizeof (u32), 0);
+  parser.ast.extra  = tape_make(sizeof (u32), 0);
+  assert(parser.ast.kinds && parser.ast.tokens && parser.ast.lhs && parser.ast.rhs && parser.ast.extra, "couldn't allocate enough memory for the AST");
+  root = parser_node_make(&parser, AST_ROOT, AST_NO_TOKEN);
+  /* the amount of root children is only known at the end, they're collected apart and then moved to 'extra' */
+  children = tape_make(sizeof (u32), 0);
+  assert(children != 0, "couldn't allocate enough memory for the AST root node");
+  while (parse_expression(&parser, &child, false)) {
+    next = tape_push(children, u32);
     assert(next != 0, "exceeded maximum AST root node capacity");
-  } while (parse_expression(&parser, next, false));
+    *next = child;
+  }
+  children_list = parser_list_make(&parser, tape_len(children));
+  (void)mem_copy(&parser.ast.extra[children_list + 1], children, tape_len(children) * sizeof (u32));
+  parser.ast.lhs[root] = children_list;
+  (void)tape_destroy(children);
   return parser;
 }
 
-/* entry point */
-void
-_start(void) {
-  struct source src;
-  struct lexer lexer;
-  struct parser parser;
+/* intermediate representation. a function is lowered to a linear list of instructions and the index of an
+ * instruction is the value it defines, so every value is assigned exactly once. functions are a single block
+ * for now and a value is always defined before its uses, so every pass is one walk over the list.
+ *
+ *   op           a                 b
+ *   IR_NOP       -                 -                       removed by a pass
+ *   IR_CONST     value             -
+ *   IR_PARAM     parameter index   -
+ *   IR_COPY      value             -
+ *   IR_ADD ...   value             value                   every binary operator, up to IR_OR
+ *   IR_CALL      callee symbol     extra: arguments list
+ *   IR_SYSCALL   -                 extra: arguments list
+ *   IR_RET       value             -
+ *
+ * lists on 'extra' are their length followed by the values */
+enum ir_op {
+  IR_NOP = 0,
+  IR_CONST,
+  IR_PARAM,
+  IR_COPY,
+  IR_ADD,
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,
+  IR_SHL,
+  IR_SHR,
+  IR_AND,
+  IR_OR,
+  IR_CALL,
+  IR_SYSCALL,
+  IR_RET
+};
+#define IR_IS_BINARY(op) ((op) >= IR_ADD && (op) <= IR_OR)
 
-  io_make();
+struct ir {
+  u8  *ops;
+  u64 *a;
+  u64 *b;
+  u32 *extra;
+  u8  *live; /* scratch flag of every value for the passes */
+};
+
+struct ir
+ir_make(void) {
+  struct ir ir;
+  ir.ops   = tape_make(sizeof (u8),  0);
+  ir.a     = tape_make(sizeof (u64), 0);
+  ir.b     = tape_make(sizeof (u64), 0);
+  ir.extra = tape_make(sizeof (u32), 0);
+  ir.live  = tape_make(sizeof (u8),  0);
+  assert(ir.ops && ir.a && ir.b && ir.extra && ir.live, "couldn't make IR buffers");
+  return ir;
+}
+
+u64
+ir_len(const struct ir *ir) {
+  if (!ir) return 0;
+  return tape_len(ir->ops);
+}
 
-  src    = file_to_source("./first.sk");
-  lexer  = source_to_lexer(&src);
-  parser = lexer_to_parser(&lexer);
-  (void)parser;
+/* the IR only holds one function at a time, this makes room for the next one */
+void
+ir_clear(struct ir *ir) {
+  assert(tape_clear(ir->ops) && tape_clear(ir->a) && tape_clear(ir->b) && tape_clear(ir->extra) && tape_clear(ir->live), "couldn't clear IR buffers");
+}
+
+u64
+ir_destroy(struct ir *ir) {
+  u64 res;
+  if (!ir || !ir->ops) return false;
+  res  = tape_destroy(ir->ops);
+  res &= tape_destroy(ir->a);
+  res &= tape_destroy(ir->b);
+  res &= tape_destroy(ir->extra);
+  res &= tape_destroy(ir->live);
+  ir->ops   = 0;
+  ir->a     = 0;
+  ir->b     = 0;
+  ir->extra = 0;
+  ir->live  = 0;
+  return res;
+}
+
+u64
+ir_value_make(struct ir *ir, enum ir_op op, u64 a, u64 b) {
+  u8 *o, *live;
+  u64 *va, *vb;
+  o    = tape_push(ir->ops,  u8);
+  va   = tape_push(ir->a,    u64);
+  vb   = tape_push(ir->b,    u64);
+  live = tape_push(ir->live, u8);
+  assert(o && va && vb && live, "exceeded maximum IR capacity");
+  *o    = op;
+  *va   = a;
+  *vb   = b;
+  *live = false;
+  return tape_len(ir->ops) - 1;
+}
+
+/* a list with room for 'amount' values, returns the index of its length */
+u64
+ir_list_make(struct ir *ir, u64 amount) {
+  u32 *list = tape_grow(ir->extra, 1 + amount, u32);
+  assert(list != 0, "exceeded maximum IR extra data capacity");
+  list[0] = amount;
+  return tape_len(ir->extra) - 1 - amount;
+}
+
+u64
+ir_list_len(const struct ir *ir, u64 list) {
+  return ir->extra[list];
+}
+
+u64
+ir_list_get(const struct ir *ir, u64 list, u64 index) {
+  return ir->extra[list + 1 + index];
+}
+
+/* the value with the copies skipped, the source of a copy was already resolved when the copy was visited */
+static u64
+ir_resolve(const struct ir *ir, u64 value) {
+  return ir->ops[value] == IR_COPY ? ir->a[value] : value;
+}
+
+/* 'x op y' like the generated code would compute it, false when it can't be known at compile time */
+static u64
+ir_fold_binary(enum ir_op op, u64 x, u64 y, u64 *out) {
+  switch (op) {
+    case IR_ADD: *out = x + y;        return true;
+    case IR_SUB: *out = x - y;        return true;
+    case IR_MUL: *out = x * y;        return true;
+    case IR_DIV: if (!y) return false; /* left for the hardware to fault on */
+                 *out = x / y;        return true;
+    case IR_SHL: *out = x << (y & 63); return true;
+    case IR_SHR: *out = x >> (y & 63); return true;
+    case IR_AND: *out = x & y;        return true;
+    case IR_OR:  *out = x | y;        return true;
+    default: return false;
+  }
+}
+
+/* constant folding and copy propagation in one forward walk. operands are rewritten to skip copies, binary
+ * operators over constants become constants and the identities like 'x + 0' or 'x * 1' become copies */
+void
+ir_fold(struct ir *ir) {
+  u64 i, j, x, y, folded, is_x_const, is_y_const;
+  enum ir_op op;
+  for (i = 0; i < ir_len(ir); i++) {
+    op = ir->ops[i];
+    if (op == IR_COPY || op == IR_RET) ir->a[i] = ir_resolve(ir, ir->a[i]);
+    if (op == IR_CALL || op == IR_SYSCALL) {
+      for (j = 0; j < ir_list_len(ir, ir->b[i]); j++) {
+        ir->extra[ir->b[i] + 1 + j] = ir_resolve(ir, ir_list_get(ir, ir->b[i], j));
+      }
+    }
+    if (!IR_IS_BINARY(op)) continue;
+    x = ir->a[i] = ir_resolve(ir, ir->a[i]);
+    y = ir->b[i] = ir_resolve(ir, ir->b[i]);
+    is_x_const = ir->ops[x] == IR_CONST;
+    is_y_const = ir->ops[y] == IR_CONST;
+    if (is_x_const && is_y_const && ir_fold_binary(op, ir->a[x], ir->a[y], &folded)) {
+      ir->ops[i] = IR_CONST;
+      ir->a[i]   = folded;
+    } else if (is_y_const && ir->a[y] == 0 && (op == IR_ADD || op == IR_SUB || op == IR_OR || op == IR_SHL || op == IR_SHR)) {
+      ir->ops[i] = IR_COPY;
+    } else if (is_x_const && ir->a[x] == 0 && (op == IR_ADD || op == IR_OR)) {
+      ir->ops[i] = IR_COPY;
+      ir->a[i]   = y;
+    } else if (is_y_const && ir->a[y] == 1 && (op == IR_MUL || op == IR_DIV)) {
+      ir->ops[i] = IR_COPY;
+    } else if (is_x_const && ir->a[x] == 1 && op == IR_MUL) {
+      ir->ops[i] = IR_COPY;
+      ir->a[i]   = y;
+    } else if ((is_x_const && ir->a[x] == 0 && (op == IR_MUL || op == IR_AND)) || (is_y_const && ir->a[y] == 0 && (op == IR_MUL || op == IR_AND))) {
+      ir->ops[i] = IR_CONST;
+      ir->a[i]   = 0;
+    }
+  }
+}
+
+/* dead code elimination, only calls, syscalls and the return are kept for their own sake. a use always comes
+ * after its value, so walking backwards sees every use before the value itself */
+void
+ir_dce(struct ir *ir) {
+  u64 i, j;
+  enum ir_op op;
+  (void)mem_set(ir->live, false, ir_len(ir));
+  for (i = ir_len(ir); i--;) {
+    op = ir->ops[i];
+    if (op == IR_CALL || op == IR_SYSCALL || op == IR_RET) ir->live[i] = true;
+    if (!ir->live[i]) {
+      ir->ops[i] = IR_NOP;
+      continue;
+    }
+    if (op == IR_COPY || op == IR_RET || IR_IS_BINARY(op)) ir->live[ir->a[i]] = true;
+    if (IR_IS_BINARY(op)) ir->live[ir->b[i]] = true;
+    if (op == IR_CALL || op == IR_SYSCALL) {
+      for (j = 0; j < ir_list_len(ir, ir->b[i]); j++) ir->live[ir_list_get(ir, ir->b[i], j)] = true;
+    }
+  }
+}
+
+/* little endian store of the low 'size' bytes of 'value' */
+static void
+bytes_put(u8 *at, u64 value, u64 size) {
+  for (; size; size--, value >>= 8) *at++ = value;
+}
+
+/* x86-64 encoder. every instruction goes to 'code' as machine code and, when 'text' is set, also as fasm
+ * source, which is only meant for debugging the encoder against the assembler */
+enum x64_reg {
+  X64_RAX = 0, X64_RCX, X64_RDX, X64_RBX, X64_RSP, X64_RBP, X64_RSI, X64_RDI,
+  X64_R8, X64_R9, X64_R10, X64_R11, X64_R12, X64_R13, X64_R14, X64_R15
+};
+
+/* the '/digit' of the 0x81 and 0x83 groups, the register to register form is 'op * 8 + 1' */
+enum x64_alu {
+  X64_ADD = 0,
+  X64_OR  = 1,
+  X64_AND = 4,
+  X64_SUB = 5,
+  X64_XOR = 6,
+  X64_CMP = 7
+};
+
+static const char *x64_reg_names[] = {
+  "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+static const char *x64_reg32_names[] = {
+  "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+/* the '/digit' of the 0xd3 group */
+enum x64_shift {
+  X64_SHL = 4,
+  X64_SHR = 5
+};
+
+static const char *x64_alu_names[] = { "add", "or", 0, 0, "and", "sub", "xor", "cmp" };
+static const char *x64_shift_names[] = { 0, 0, 0, 0, "shl", "shr" };
+
+#define X64_REX(w, r, b)        (0x40 | (w) << 3 | ((r) >> 3) << 2 | ((b) >> 3))
+#define X64_MODRM(mod, reg, rm) ((mod) << 6 | ((reg) & 7) << 3 | ((rm) & 7))
+#define X64_NO_OFFSET (~0ul)
+
+struct x64_label {
+  struct string name;
+  u64 offset;    /* 'X64_NO_OFFSET' until it's placed */
+  u64 is_public; /* exported on relocatable objects */
+};
+
+/* rel32 at 'offset' on 'code' that must reach 'label' */
+struct x64_fixup {
+  u64 offset;
+  u64 label;
+};
+
+struct x64 {
+  u8 *code;
+  struct x64_label *labels;
+  struct x64_fixup *fixups;
+  struct string_builder *text;
+};
+
+struct x64
+x64_make(struct string_builder *text) {
+  struct x64 x64;
+  x64.code   = tape_make(sizeof (u8), 0);
+  x64.labels = tape_make(sizeof (struct x64_label), 0);
+  x64.fixups = tape_make(sizeof (struct x64_fixup), 0);
+  x64.text   = text;
+  assert(x64.code && x64.labels && x64.fixups, "couldn't make code buffers");
+  return x64;
+}
+
+u64
+x64_destroy(struct x64 *x64) {
+  u64 res;
+  if (!x64 || !x64->code) return false;
+  res  = tape_destroy(x64->code);
+  res &= tape_destroy(x64->labels);
+  res &= tape_destroy(x64->fixups);
+  x64->code   = 0;
+  x64->labels = 0;
+  x64->fixups = 0;
+  return res;
+}
+
+static u8 *
+x64_emit(struct x64 *x64, u64 amount) {
+  u8 *at = tape_grow(x64->code, amount, u8);
+  assert(at != 0, "exceeded maximum code size");
+  return at;
+}
+
+static void
+x64_text_cstr(struct x64 *x64, const char *buf) {
+  assert(string_builder_append_cstr(x64->text, buf), "couldn't write fasm output");
+}
+
+static void
+x64_text_string(struct x64 *x64, const struct string *s) {
+  assert(string_builder_append(x64->text, s), "couldn't write fasm output");
+}
+
+static void
+x64_text_u64(struct x64 *x64, u64 value) {
+  assert(string_builder_append_u64(x64->text, value), "couldn't write fasm output");
+}
+
+static void
+x64_text_mem(struct x64 *x64, u64 base, u64 disp) {
+  x64_text_cstr(x64, "[");
+  x64_text_cstr(x64, x64_reg_names[base]);
+  if (disp) {
+    x64_text_cstr(x64, is_neg(disp) ? "-" : "+");
+    x64_text_u64(x64, is_neg(disp) ? -disp : disp);
+  }
+  x64_text_cstr(x64, "]");
+}
+
+/* "  mnemonic op0, op1", an empty operand is written by the caller right after */
+static void
+x64_text_ins(struct x64 *x64, const char *mnemonic, const char *op0, const char *op1) {
+  x64_text_cstr(x64, "  ");
+  x64_text_cstr(x64, mnemonic);
+  if (op0) {
+    x64_text_cstr(x64, " ");
+    x64_text_cstr(x64, op0);
+  }
+  if (op1) {
+    x64_text_cstr(x64, ", ");
+    x64_text_cstr(x64, op1);
+  }
+}
+
+/* the fasm output is streamed to the builder's fd in chunks while the code is still being generated */
+#define X64_TEXT_CHUNK_SIZE (1ul << 16)
+static void
+x64_text_end(struct x64 *x64) {
+  x64_text_cstr(x64, "\n");
+  if (x64->text->len < X64_TEXT_CHUNK_SIZE) return;
+  assert(string_builder_flush(x64->text), "couldn't write fasm output");
+}
+#undef X64_TEXT_CHUNK_SIZE
+
+/* ModRM, SIB and displacement of '[base + disp]', 'disp' is signed */
+static void
+x64_emit_mem(struct x64 *x64, u64 reg, u64 base, u64 disp) {
+  u8 *at;
+  u64 mod, sib;
+  assert(disp + 0x80000000 < 0x100000000, "x64_emit_mem: displacement doesn't fit on 32 bits");
+  mod = disp == 0 && (base & 7) != X64_RBP ? 0 : disp + 128 < 256 ? 1 : 2;
+  sib = (base & 7) == X64_RSP;
+  at = x64_emit(x64, 1 + sib + (mod == 1 ? 1 : mod == 2 ? 4 : 0));
+  *at++ = X64_MODRM(mod, reg, base);
+  if (sib) *at++ = 0x24;
+  if (mod == 1) *at = disp;
+  if (mod == 2) bytes_put(at, disp, 4);
+}
+
+u64
+x64_label_make(struct x64 *x64, const struct string *name, u64 is_public) {
+  struct x64_label *label = tape_push(x64->labels, struct x64_label);
+  assert(label != 0, "exceeded maximum label amount");
+  label->name      = *name;
+  label->offset    = X64_NO_OFFSET;
+  label->is_public = is_public;
+  return tape_len(x64->labels) - 1;
+}
+
+void
+x64_label_place(struct x64 *x64, u64 label) {
+  x64->labels[label].offset = tape_len(x64->code);
+  if (!x64->text) return;
+  x64_text_string(x64, &x64->labels[label].name);
+  x64_text_cstr(x64, ":\n");
+}
+
+void
+x64_mov_rr(struct x64 *x64, u64 dst, u64 src) {
+  u8 *at = x64_emit(x64, 3);
+  at[0] = X64_REX(1, src, dst);
+  at[1] = 0x89;
+  at[2] = X64_MODRM(3, src, dst);
+  if (x64->text) {
+    x64_text_ins(x64, "mov", x64_reg_names[dst], x64_reg_names[src]);
+    x64_text_end(x64);
+  }
+}
+
+/* picks the shortest encoding, a 32 bit move already zeroes the high half */
+void
+x64_mov_ri(struct x64 *x64, u64 dst, u64 imm) {
+  u8 *at;
+  if (imm <= 0xffffffff) {
+    at = x64_emit(x64, 5 + (dst >= X64_R8));
+    if (dst >= X64_R8) *at++ = X64_REX(0, 0, dst);
+    *at++ = 0xb8 + (dst & 7);
+    bytes_put(at, imm, 4);
+  } else if (imm + 0x80000000 < 0x100000000) {
+    at = x64_emit(x64, 7);
+    *at++ = X64_REX(1, 0, dst);
+    *at++ = 0xc7;
+    *at++ = X64_MODRM(3, 0, dst);
+    bytes_put(at, imm, 4);
+  } else {
+    at = x64_emit(x64, 10);
+    *at++ = X64_REX(1, 0, dst);
+    *at++ = 0xb8 + (dst & 7);
+    bytes_put(at, imm, 8);
+  }
+  if (x64->text) {
+    x64_text_ins(x64, "mov", imm <= 0xffffffff ? x64_reg32_names[dst] : x64_reg_names[dst], "");
+    x64_text_u64(x64, imm);
+    x64_text_end(x64);
+  }
+}
+
+/* mov dst, [base + disp] */
+void
+x64_load(struct x64 *x64, u64 dst, u64 base, u64 disp) {
+  u8 *at = x64_emit(x64, 2);
+  at[0] = X64_REX(1, dst, base);
+  at[1] = 0x8b;
+  x64_emit_mem(x64, dst, base, disp);
+  if (x64->text) {
+    x64_text_ins(x64, "mov", x64_reg_names[dst], "");
+    x64_text_mem(x64, base, disp);
+    x64_text_end(x64);
+  }
+}
+
+/* mov [base + disp], src */
+void
+x64_store(struct x64 *x64, u64 base, u64 disp, u64 src) {
+  u8 *at = x64_emit(x64, 2);
+  at[0] = X64_REX(1, src, base);
+  at[1] = 0x89;
+  x64_emit_mem(x64, src, base, disp);
+  if (x64->text) {
+    x64_text_ins(x64, "mov", "", 0);
+    x64_text_mem(x64, base, disp);
+    x64_text_cstr(x64, ", ");
+    x64_text_cstr(x64, x64_reg_names[src]);
+    x64_text_end(x64);
+  }
+}
+
+void
+x64_push(struct x64 *x64, u64 reg) {
+  u8 *at = x64_emit(x64, 1 + (reg >= X64_R8));
+  if (reg >= X64_R8) *at++ = X64_REX(0, 0, reg);
+  *at = 0x50 + (reg & 7);
+  if (x64->text) {
+    x64_text_ins(x64, "push", x64_reg_names[reg], 0);
+    x64_text_end(x64);
+  }
+}
+
+void
+x64_pop(struct x64 *x64, u64 reg) {
+  u8 *at = x64_emit(x64, 1 + (reg >= X64_R8));
+  if (reg >= X64_R8) *at++ = X64_REX(0, 0, reg);
+  *at = 0x58 + (reg & 7);
+  if (x64->text) {
+    x64_text_ins(x64, "pop", x64_reg_names[reg], 0);
+    x64_text_end(x64);
+  }
+}
+
+void
+x64_alu_rr(struct x64 *x64, enum x64_alu op, u64 dst, u64 src) {
+  u8 *at = x64_emit(x64, 3);
+  at[0] = X64_REX(1, src, dst);
+  at[1] = op * 8 + 1;
+  at[2] = X64_MODRM(3, src, dst);
+  if (x64->text) {
+    x64_text_ins(x64, x64_alu_names[op], x64_reg_names[dst], x64_reg_names[src]);
+    x64_text_end(x64);
+  }
+}
+
+/* 'imm' is sign extended from 32 bits */
+void
+x64_alu_ri(struct x64 *x64, enum x64_alu op, u64 dst, u64 imm) {
+  u8 *at;
+  assert(imm + 0x80000000 < 0x100000000, "x64_alu_ri: immediate doesn't fit on 32 bits");
+  if (imm + 128 < 256) {
+    at = x64_emit(x64, 4);
+    at[3] = imm;
+  } else {
+    at = x64_emit(x64, 7);
+    bytes_put(&at[3], imm, 4);
+  }
+  at[0] = X64_REX(1, 0, dst);
+  at[1] = imm + 128 < 256 ? 0x83 : 0x81;
+  at[2] = X64_MODRM(3, op, dst);
+  if (x64->text) {
+    x64_text_ins(x64, x64_alu_names[op], x64_reg_names[dst], "");
+    if (is_neg(imm)) x64_text_cstr(x64, "-");
+    x64_text_u64(x64, is_neg(imm) ? -imm : imm);
+    x64_text_end(x64);
+  }
+}
+
+void
+x64_imul_rr(struct x64 *x64, u64 dst, u64 src) {
+  u8 *at = x64_emit(x64, 4);
+  at[0] = X64_REX(1, dst, src);
+  at[1] = 0x0f;
+  at[2] = 0xaf;
+  at[3] = X64_MODRM(3, dst, src);
+  if (x64->text) {
+    x64_text_ins(x64, "imul", x64_reg_names[dst], x64_reg_names[src]);
+    x64_text_end(x64);
+  }
+}
+
+/* unsigned rdx:rax / src, quotient on rax and remainder on rdx */
+void
+x64_div_r(struct x64 *x64, u64 src) {
+  u8 *at = x64_emit(x64, 3);
+  at[0] = X64_REX(1, 0, src);
+  at[1] = 0xf7;
+  at[2] = X64_MODRM(3, 6, src);
+  if (x64->text) {
+    x64_text_ins(x64, "div", x64_reg_names[src], 0);
+    x64_text_end(x64);
+  }
+}
+
+/* shifts 'dst' by cl */
+void
+x64_shift_cl(struct x64 *x64, enum x64_shift op, u64 dst) {
+  u8 *at = x64_emit(x64, 3);
+  at[0] = X64_REX(1, 0, dst);
+  at[1] = 0xd3;
+  at[2] = X64_MODRM(3, op, dst);
+  if (x64->text) {
+    x64_text_ins(x64, x64_shift_names[op], x64_reg_names[dst], "cl");
+    x64_text_end(x64);
+  }
+}
+
+/* shifts 'dst' by 'imm & 63' */
+void
+x64_shift_ri(struct x64 *x64, enum x64_shift op, u64 dst, u64 imm) {
+  u8 *at = x64_emit(x64, 4);
+  at[0] = X64_REX(1, 0, dst);
+  at[1] = 0xc1;
+  at[2] = X64_MODRM(3, op, dst);
+  at[3] = imm & 63;
+  if (x64->text) {
+    x64_text_ins(x64, x64_shift_names[op], x64_reg_names[dst], "");
+    x64_text_u64(x64, imm & 63);
+    x64_text_end(x64);
+  }
+}
+
+static void
+x64_rel32(struct x64 *x64, u8 opcode, const char *mnemonic, u64 label) {
+  struct x64_fixup *fixup;
+  u8 *at = x64_emit(x64, 5);
+  at[0] = opcode;
+  fixup = tape_push(x64->fixups, struct x64_fixup);
+  assert(fixup != 0, "exceeded maximum fixup amount");
+  fixup->offset = tape_len(x64->code) - 4;
+  fixup->label  = label;
+  if (x64->text) {
+    x64_text_ins(x64, mnemonic, "", 0);
+    x64_text_string(x64, &x64->labels[label].name);
+    x64_text_end(x64);
+  }
+}
+
+void
+x64_call(struct x64 *x64, u64 label) {
+  x64_rel32(x64, 0xe8, "call", label);
+}
+
+void
+x64_jmp(struct x64 *x64, u64 label) {
+  x64_rel32(x64, 0xe9, "jmp", label);
+}
+
+void
+x64_ret(struct x64 *x64) {
+  *x64_emit(x64, 1) = 0xc3;
+  if (!x64->text) return;
+  x64_text_ins(x64, "ret", 0, 0);
+  x64_text_end(x64);
+}
+
+void
+x64_syscall(struct x64 *x64) {
+  u8 *at = x64_emit(x64, 2);
+  at[0] = 0x0f;
+  at[1] = 0x05;
+  if (!x64->text) return;
+  x64_text_ins(x64, "syscall", 0, 0);
+  x64_text_end(x64);
+}
+
+/* resolves every rel32, all labels must be placed by now */
+void
+x64_link(struct x64 *x64) {
+  u64 i, target;
+  for (i = 0; i < tape_len(x64->fixups); i++) {
+    target = x64->labels[x64->fixups[i].label].offset;
+    assert(target != X64_NO_OFFSET, "x64_link: jump to a label that was never placed");
+    bytes_put(&x64->code[x64->fixups[i].offset], target - (x64->fixups[i].offset + 4), 4);
+  }
+}
+
+#undef X64_REX
+#undef X64_MODRM
+
+/* ELF64 output. the whole file is built on one tape so it can be written with a single 'write' */
+#define ELF_BASE_ADDR 0x400000ul
+#define ELF_EHDR_SIZE 64
+#define ELF_PHDR_SIZE 56
+#define ELF_SHDR_SIZE 64
+#define ELF_SYM_SIZE  24
+#define ELF_ET_REL    1
+#define ELF_ET_EXEC   2
+
+static u8 *
+elf_grow(u8 *out, u64 amount) {
+  u8 *at = tape_grow(out, amount, u8);
+  assert(at != 0, "exceeded maximum output file size");
+  return mem_set(at, 0, amount);
+}
+
+static void
+elf_header(u8 *out, u64 type, u64 entry, u64 phnum, u64 shoff, u64 shnum, u64 shstrndx) {
+  out[0] = 0x7f;
+  out[1] = 'E';
+  out[2] = 'L';
+  out[3] = 'F';
+  out[4] = 2; /* 64 bits */
+  out[5] = 1; /* little endian */
+  out[6] = 1; /* version */
+  bytes_put(&out[16], type,  2);
+  bytes_put(&out[18], 62,    2); /* x86-64 */
+  bytes_put(&out[20], 1,     4);
+  bytes_put(&out[24], entry, 8);
+  bytes_put(&out[32], phnum ? ELF_EHDR_SIZE : 0, 8);
+  bytes_put(&out[40], shoff, 8);
+  bytes_put(&out[52], ELF_EHDR_SIZE, 2);
+  bytes_put(&out[54], phnum ? ELF_PHDR_SIZE : 0, 2);
+  bytes_put(&out[56], phnum, 2);
+  bytes_put(&out[58], shnum ? ELF_SHDR_SIZE : 0, 2);
+  bytes_put(&out[60], shnum, 2);
+  bytes_put(&out[62], shstrndx, 2);
+}
+
+/* static executable with a single read and execute segment that maps the whole file, like fasm does */
+u8 *
+elf_make_executable(const struct x64 *x64, u64 entry_label) {
+  u8 *out, *phdr;
+  u64 code_off, size;
+  out = tape_make(sizeof (u8), 0);
+  assert(out != 0, "couldn't make output file buffer");
+  code_off = ELF_EHDR_SIZE + ELF_PHDR_SIZE;
+  size = code_off + tape_len(x64->code);
+  (void)elf_grow(out, code_off);
+  mem_copy(elf_grow(out, tape_len(x64->code)), x64->code, tape_len(x64->code));
+  elf_header(out, ELF_ET_EXEC, ELF_BASE_ADDR + code_off + x64->labels[entry_label].offset, 1, 0, 0, 0);
+  phdr = &out[ELF_EHDR_SIZE];
+  bytes_put(&phdr[0],  1, 4);     /* PT_LOAD */
+  bytes_put(&phdr[4],  4 | 1, 4); /* PF_R | PF_X */
+  bytes_put(&phdr[16], ELF_BASE_ADDR, 8);
+  bytes_put(&phdr[24], ELF_BASE_ADDR, 8);
+  bytes_put(&phdr[32], size, 8);
+  bytes_put(&phdr[40], size, 8);
+  bytes_put(&phdr[48], PAGE_SIZE, 8);
+  return out;
+}
+
+static void
+elf_section(u8 *out, u64 shoff, u64 index, u64 name, u64 type, u64 flags, u64 off, u64 size, u64 link, u64 info, u64 align, u64 entsize) {
+  u8 *shdr = &out[shoff + index * ELF_SHDR_SIZE];
+  bytes_put(&shdr[0],  name,    4);
+  bytes_put(&shdr[4],  type,    4);
+  bytes_put(&shdr[8],  flags,   8);
+  bytes_put(&shdr[24], off,     8);
+  bytes_put(&shdr[32], size,    8);
+  bytes_put(&shdr[40], link,    4);
+  bytes_put(&shdr[44], info,    4);
+  bytes_put(&shdr[48], align,   8);
+  bytes_put(&shdr[56], entsize, 8);
+}
+
+#define ELF_SHSTRTAB "\0.text\0.symtab\0.strtab\0.shstrtab\0.note.GNU-stack"
+/* relocatable object, public labels are global symbols and the rest are local. every jump is already
+ * resolved by 'x64_link', so there's nothing to relocate until there are external symbols */
+u8 *
+elf_make_object(const struct x64 *x64) {
+  u8 *out, *sym;
+  u64 i, pass, text_off, symtab_off, strtab_off, shstrtab_off, shoff, sym_amount, first_global, name_off;
+  const struct x64_label *label;
+  out = tape_make(sizeof (u8), 0);
+  assert(out != 0, "couldn't make output file buffer");
+  (void)elf_grow(out, ELF_EHDR_SIZE);
+  text_off = tape_len(out);
+  mem_copy(elf_grow(out, tape_len(x64->code)), x64->code, tape_len(x64->code));
+  (void)elf_grow(out, (8 - (tape_len(out) & 7)) & 7);
+  /* ELF wants the local symbols before the global ones */
+  symtab_off = tape_len(out);
+  sym_amount = 1 + tape_len(x64->labels);
+  (void)elf_grow(out, sym_amount * ELF_SYM_SIZE);
+  first_global = 1;
+  name_off = 1;
+  sym = &out[symtab_off + ELF_SYM_SIZE];
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < tape_len(x64->labels); i++) {
+      label = &x64->labels[i];
+      if (label->is_public != pass) continue;
+      bytes_put(&sym[0], name_off, 4);
+      sym[4] = (pass ? 1 : 0) << 4 | 2; /* STB_LOCAL or STB_GLOBAL, STT_FUNC */
+      bytes_put(&sym[6], 1, 2);         /* .text */
+      bytes_put(&sym[8], label->offset, 8);
+      name_off += label->name.len + 1;
+      sym += ELF_SYM_SIZE;
+      first_global += !pass;
+    }
+  }
+  strtab_off = tape_len(out);
+  (void)elf_grow(out, 1);
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < tape_len(x64->labels); i++) {
+      label = &x64->labels[i];
+      if (label->is_public != pass) continue;
+      mem_copy(elf_grow(out, label->name.len + 1), label->name.buf, label->name.len);
+    }
+  }
+  shstrtab_off = tape_len(out);
+  mem_copy(elf_grow(out, sizeof (ELF_SHSTRTAB)), ELF_SHSTRTAB, sizeof (ELF_SHSTRTAB));
+  (void)elf_grow(out, (8 - (tape_len(out) & 7)) & 7);
+  shoff = tape_len(out);
+  (void)elf_grow(out, 6 * ELF_SHDR_SIZE);
+  elf_header(out, ELF_ET_REL, 0, 0, shoff, 6, 4);
+  elf_section(out, shoff, 1, 1,  1, 2 | 4, text_off, tape_len(x64->code), 0, 0, 16, 0);
+  elf_section(out, shoff, 2, 7,  2, 0, symtab_off, sym_amount * ELF_SYM_SIZE, 3, first_global, 8, ELF_SYM_SIZE);
+  elf_section(out, shoff, 3, 15, 3, 0, strtab_off, shstrtab_off - strtab_off, 0, 0, 1, 0);
+  elf_section(out, shoff, 4, 23, 3, 0, shstrtab_off, sizeof (ELF_SHSTRTAB), 0, 0, 1, 0);
+  elf_section(out, shoff, 5, 33, 1, 0, shoff, 0, 0, 0, 1, 0);
+  return out;
+}
+#undef ELF_SHSTRTAB
+
+u64
+file_write(const char *path, const void *buf, u64 len, u64 mode) {
+  u64 fd, res;
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+  if (is_neg(fd)) return false;
+  res = write(fd, buf, len) == len;
+  return close(fd) == 0 && res;
+}
+
+/* 'path' followed by 'suffix' on 'out', false when it doesn't fit on 'cap' bytes */
+u64
+path_append(char *out, u64 cap, const char *path, const char *suffix) {
+  u64 path_len = cstring_len(path), suffix_len = cstring_len(suffix);
+  if (path_len + suffix_len + 1 > cap) return false;
+  (void)mem_copy(out, path, path_len);
+  (void)mem_copy(out + path_len, suffix, suffix_len + 1);
+  return true;
+}
+
+/* on-disk caches. they're only kept when there's a directory for them, and all of them go there, named by a
+ * hash of what they're for. 'compiler' is a hash of the starc binary itself, every cache is keyed by it too so
+ * whatever an older compiler left is never read */
+struct caches {
+  const char *dir;
+  u64 compiler;
+};
+
+static struct caches caches;
+
+/* keeps the caches on 'dir', which is made when it's missing. false, leaving them off, when the directory or
+ * the binary can't be used */
+u64
+caches_init(const char *dir) {
+  struct stat st;
+  u64 fd, res;
+  const u8 *exe;
+  res = mkdir(dir, 0755);
+  if (is_neg(res) && res != -17ul) return false; /* EEXIST */
+  fd = open("/proc/self/exe", O_RDONLY, 0);
+  if (is_neg(fd)) return false;
+  exe = MAP_FAILED;
+  if (!is_neg(fstat(fd, &st)) && st.st_size) exe = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  (void)close(fd);
+  if (exe == MAP_FAILED) return false;
+  caches.compiler = hash_bytes((const char *)exe, st.st_size);
+  (void)munmap((void *)exe, st.st_size);
+  caches.dir = dir;
+  return true;
+}
+
+/* 'dir/<key in hex><suffix>' on 'out', false when the caches are off or it doesn't fit */
+u64
+cache_path(char *out, u64 cap, u64 key, const char *suffix) {
+  char hex[18], name[32];
+  u64 i;
+  if (!caches.dir) return false;
+  hex[0] = '/';
+  for (i = 0; i < 16; i++) hex[1 + i] = "0123456789abcdef"[key >> (60 - i * 4) & 15];
+  hex[17] = '\0';
+  /* 'path_append' can't write over its own input, so the name is put together on its own first */
+  return path_append(name, sizeof (name), hex, suffix) && path_append(out, cap, caches.dir, name);
+}
+
+/* writes a cache next to 'path' and renames it over it, so a build that maps the cache never sees it half
+ * written. the temporary file is named after the process, so two builds at once don't share it */
+u64
+cache_write(const char *path, const void *buf, u64 len) {
+  char tmp[PATH_MAX], pid[32];
+  u64 i, n;
+  n = getpid();
+  i = sizeof (pid) - sizeof (".tmp");
+  (void)mem_copy(pid + i, ".tmp", sizeof (".tmp"));
+  do pid[--i] = '0' + n % 10; while (n /= 10);
+  pid[--i] = '.';
+  if (!path_append(tmp, sizeof (tmp), path, pid + i)) return false;
+  if (file_write(tmp, buf, len, 0644) && !is_neg(rename(tmp, path))) return true;
+  (void)unlink(tmp); /* half written or not renamed, either way nobody else would remove it */
+  return false;
+}
+
+/* child processes */
+#define PROCESS_PATH_MAX 4096
+
+/* the child side of 'process_run', only returns if no 'execve' worked */
+static void
+process_exec(const char *name, char **argv, char **envp) {
+  char full[PROCESS_PATH_MAX];
+  const char *path;
+  u64 i, dir_len, name_len;
+  name_len = cstring_len(name);
+  if (mem_find(name, '/', name_len) != name_len) {
+    (void)execve(name, argv, envp);
+    return;
+  }
+  path = "";
+  for (i = 0; envp && envp[i]; i++) {
+    if (envp[i][0] == 'P' && envp[i][1] == 'A' && envp[i][2] == 'T' && envp[i][3] == 'H' && envp[i][4] == '=') path = envp[i] + 5;
+  }
+  for (;;) {
+    dir_len = mem_find(path, ':', cstring_len(path));
+    if (dir_len && dir_len + 1 + name_len < PROCESS_PATH_MAX) {
+      (void)mem_copy(full, path, dir_len);
+      full[dir_len] = '/';
+      (void)mem_copy(&full[dir_len + 1], name, name_len + 1);
+      (void)execve(full, argv, envp);
+    }
+    if (path[dir_len] == '\0') return;
+    path += dir_len + 1;
+  }
+}
+
+/* runs 'name', looked up on the PATH of 'envp' like a shell would, with 'stdin_fd' as its standard input.
+ * returns the exit code, or -1 when it couldn't be started or was killed by a signal */
+u64
+process_run(const char *name, char **argv, char **envp, u64 stdin_fd) {
+  u64 pid, status;
+  pid = fork();
+  if (is_neg(pid)) return -1;
+  if (pid == 0) {
+    if (stdin_fd == STDIN || !is_neg(dup2(stdin_fd, STDIN))) process_exec(name, argv, envp);
+    exit(127);
+  }
+  status = 0;
+  if (is_neg(wait4(pid, &status, 0))) return -1;
+  if (status & 0x7f) return -1;
+  return (status >> 8) & 0xff;
+}
+#undef PROCESS_PATH_MAX
+
+/* thread pool on raw 'clone' and futexes. 'pool_run' splits the tasks on contiguous ranges, one for every
+ * worker, and the calling thread works as worker 0. a worker takes its own tasks in order from the front of its
+ * range and steals from the back of the others, so a pool with a single worker still goes in order. a range is
+ * 'front << 32 | back' on one word, taking from either end of it is a single compare and swap */
+#define POOL_STACK_SIZE (8ul << 20)
+
+struct pool_worker {
+  volatile u64 range;
+  volatile u64 tid; /* futex, cleared by the kernel when the thread is gone */
+  struct pool *pool;
+  u64 index;
+  u8 *stack;
+  u8 pad[24]; /* every worker on its own cache line, the ranges are written all the time */
+};
+
+struct pool {
+  struct pool_worker *workers;
+  u64 amount;
+  void (*task)(void *ctx, u64 index, u64 worker);
+  void *ctx;
+  volatile u64 generation; /* futex, bumped by every 'pool_run' and by 'pool_destroy' */
+  volatile u64 pending;    /* futex, tasks that didn't finish yet */
+  volatile u64 quit;
+  u64 is_started;
+};
+
+/* how many cpus this process may run on */
+u64
+cpu_count(void) {
+  u64 mask[16], res, i, amount = 0;
+  res = __syscall__(SYS_SCHED_GETAFFINITY, 0, sizeof (mask), (u64)mask, 0, 0, 0);
+  if (is_neg(res)) return 1;
+  for (i = 0; i < res / 8; i++) {
+    for (; mask[i]; mask[i] &= mask[i] - 1) amount++;
+  }
+  return amount ? amount : 1;
+}
+
+static u64
+pool_take(struct pool_worker *worker, u64 is_front, u64 *task) {
+  u64 range, front, back;
+  for (;;) {
+    range = worker->range;
+    front = range >> 32;
+    back  = range & 0xffffffff;
+    if (front >= back) return false;
+    if (is_front && atomic_cas(&worker->range, range, (front + 1) << 32 | back)) {
+      *task = front;
+      return true;
+    }
+    if (!is_front && atomic_cas(&worker->range, range, front << 32 | (back - 1))) {
+      *task = back - 1;
+      return true;
+    }
+  }
+}
+
+/* no task is added while the pool runs, so once every range is empty the worker is done */
+static void
+pool_work(struct pool *pool, u64 self) {
+  u64 i, task;
+  for (;;) {
+    if (!pool_take(&pool->workers[self], true, &task)) {
+      for (i = 1; i < pool->amount && !pool_take(&pool->workers[(self + i) % pool->amount], false, &task); i++);
+      if (i == pool->amount) return;
+    }
+    pool->task(pool->ctx, task, self);
+    if (atomic_add(&pool->pending, -1ul) == 1) futex_wake(&pool->pending);
+  }
+}
+
+static void
+pool_thread(void *arg) {
+  struct pool_worker *worker = arg;
+  struct pool *pool = worker->pool;
+  u64 seen = 0;
+  for (;;) {
+    while (pool->generation == seen) futex_wait(&pool->generation, seen);
+    seen = pool->generation;
+    if (pool->quit) return;
+    pool_work(pool, worker->index);
+  }
+}
+
+/* a pool with 'amount' workers, the calling thread included. the threads are only spawned by the first
+ * 'pool_run', when the pool already is where it'll stay */
+struct pool
+pool_make(u64 amount) {
+  struct pool pool;
+  u64 i;
+  if (!amount) amount = 1;
+  pool.amount     = amount;
+  pool.generation = 0;
+  pool.pending    = 0;
+  pool.quit       = false;
+  pool.is_started = false;
+  pool.workers    = tape_make(sizeof (struct pool_worker), amount);
+  assert(pool.workers && tape_grow(pool.workers, amount, struct pool_worker), "couldn't make thread pool");
+  for (i = 0; i < amount; i++) {
+    pool.workers[i].range = 0;
+    pool.workers[i].tid   = 0;
+    pool.workers[i].index = i;
+    pool.workers[i].stack = 0;
+  }
+  return pool;
+}
+
+static void
+pool_start(struct pool *pool) {
+  struct pool_worker *worker;
+  u64 i;
+  pool->is_started = true;
+  for (i = 1; i < pool->amount; i++) {
+    worker = &pool->workers[i];
+    worker->pool  = pool;
+    worker->stack = mmap(0, POOL_STACK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    assert(worker->stack != MAP_FAILED, "couldn't map a thread stack");
+    assert(!is_neg(thread_spawn(worker->stack + POOL_STACK_SIZE, pool_thread, worker, &worker->tid)), "couldn't spawn a thread");
+  }
+}
+
+/* runs 'task(ctx, i, worker)' for every 'i' below 'amount' and returns once all of them finished. 'worker' is
+ * the one running it, below the amount of workers, so a task can keep state for its worker without atomics */
+void
+pool_run(struct pool *pool, void (*task)(void *ctx, u64 index, u64 worker), void *ctx, u64 amount) {
+  u64 i, pending;
+  assert(amount <= 0xffffffff, "pool_run: too many tasks");
+  if (!pool->is_started) pool_start(pool);
+  pool->task    = task;
+  pool->ctx     = ctx;
+  pool->pending = amount;
+  for (i = 0; i < pool->amount; i++) {
+    pool->workers[i].range = (amount * i / pool->amount) << 32 | amount * (i + 1) / pool->amount;
+  }
+  (void)atomic_add(&pool->generation, 1);
+  futex_wake(&pool->generation);
+  pool_work(pool, 0);
+  while ((pending = pool->pending)) futex_wait(&pool->pending, pending);
+}
+
+u64
+pool_destroy(struct pool *pool) {
+  u64 i, tid, res = true;
+  if (!pool || !pool->workers) return false;
+  pool->quit = true;
+  (void)atomic_add(&pool->generation, 1);
+  futex_wake(&pool->generation);
+  for (i = 1; i < pool->amount; i++) {
+    if (!pool->workers[i].stack) continue;
+    while ((tid = pool->workers[i].tid)) futex_wait(&pool->workers[i].tid, tid);
+    res &= munmap(pool->workers[i].stack, POOL_STACK_SIZE) == 0;
+  }
+  res &= tape_destroy(pool->workers);
+  pool->workers = 0;
+  return res;
+}
+
+/* modules, one for every source file of the build. a module is lexed and parsed with an interner of its own,
+ * so the workers only share the tape of the symbol tables while they go through the modules in parallel. once
+ * all of them are done their names are merged, in order, on the interner of the whole build */
+struct module {
+  struct source src;
+  struct interner names;
+  struct lexer lexer;
+  struct parser parser;
+  u32 *syms; /* symbol id on the whole build, indexed by the id on 'names', on 'module_syms' */
+  u64 hash;  /* of the source */
+};
+
+/* the symbol tables of all the modules are on one shared tape. every worker makes the tables of the modules it
+ * went through with a chunk of its own as soon as it knows their size, the tables are filled once the names are
+ * merged */
+static u32 *module_syms;
+
+struct module_worker {
+  struct tape_chunk syms;
+  u8 pad[40]; /* every worker on its own cache line */
+};
+
+static struct module_worker *module_workers;
+
+/* module cache, what the front end made of a module. it's kept on the cache directory by the path of the source,
+ * checked against the content of it and the compiler, and holds the tapes of the lexer and of the AST one after
+ * the other, each one with its header. so the file is mapped and its tapes are used right where they are, as
+ * static tapes. the names are kept as offsets on the source, which is read anyway for the hash and the error
+ * messages */
+#define MODULE_CACHE_MAGIC 0x00646d6372617473ul /* "starcmd" */
+#define MODULE_CACHE_TAPES 9
+
+struct module_cache {
+  u64 magic;
+  u64 compiler; /* 'caches.compiler' of the starc that wrote it */
+  u64 hash; /* of the source */
+  u64 size; /* of the whole file */
+  u64 tapes[MODULE_CACHE_TAPES]; /* offset of the header of every tape from this one, see 'module_cache_typs' */
+};
+
+struct module_name {
+  u64 offset; /* on the source */
+  u64 len;
+};
+
+/* element size of the lexer's kinds, offsets and values, the names and the AST's kinds, tokens, lhs, rhs and
+ * extra, the order they're kept on */
+static const u64 module_cache_typs[MODULE_CACHE_TAPES] = {
+  sizeof (u8), sizeof (u32), sizeof (u32), sizeof (struct module_name),
+  sizeof (u8), sizeof (u32), sizeof (u32), sizeof (u32), sizeof (u32)
+};
+
+u64
+module_cache_save(const struct module *module, const char *path) {
+  struct module_cache *cache;
+  struct module_name *name;
+  struct tape_header *out;
+  void *tapes[MODULE_CACHE_TAPES];
+  u8 *image, *names;
+  u64 i, len, res;
+  names = tape_make(sizeof (struct module_name), 0);
+  image = tape_make(sizeof (u8), 0);
+  if (!names || !image || !tape_grow(image, sizeof (struct module_cache), u8)) return false;
+  for (i = 0; i < tape_len(module->names.names); i++) {
+    if (!(name = tape_push(names, struct module_name))) return false;
+    name->offset = i == SYM_NONE ? 0 : module->names.names[i].buf - module->src.data.buf;
+    name->len    = module->names.names[i].len;
+  }
+  tapes[0] = module->lexer.kinds;
+  tapes[1] = module->lexer.offsets;
+  tapes[2] = module->lexer.values;
+  tapes[3] = names;
+  tapes[4] = module->parser.ast.kinds;
+  tapes[5] = module->parser.ast.tokens;
+  tapes[6] = module->parser.ast.lhs;
+  tapes[7] = module->parser.ast.rhs;
+  tapes[8] = module->parser.ast.extra;
+  cache = (struct module_cache *)image;
+  for (i = 0; i < MODULE_CACHE_TAPES; i++) {
+    len = tape_len(tapes[i]) * module_cache_typs[i];
+    cache->tapes[i] = tape_len(image);
+    if (!(out = (struct tape_header *)tape_grow(image, (sizeof (struct tape_header) + len + 7) & ~7ul, u8))) return false;
+    out->len   = tape_len(tapes[i]);
+    out->cap   = len;
+    out->typ   = module_cache_typs[i];
+    out->flags = TAPE_STATIC;
+    out->top   = sizeof (struct tape_header) + len;
+    out->dirty = 0;
+    (void)mem_copy(out + 1, tapes[i], len);
+  }
+  cache->magic    = MODULE_CACHE_MAGIC;
+  cache->compiler = caches.compiler;
+  cache->hash     = module->hash;
+  cache->size     = tape_len(image);
+  res = cache_write(path, image, cache->size);
+  (void)tape_destroy(names);
+  (void)tape_destroy(image);
+  return res;
+}
+
+/* every index on the lexer and the AST of a cache file is in range, so a file that's damaged or stale but still
+ * passes the header check is a miss instead of reads out of bounds. 'names' is the amount of names, 'src_len'
+ * the size of the source */
+static u64
+module_cache_check(u8 *const *tapes, u64 names, u64 src_len) {
+  const struct module_name *name = (const struct module_name *)tapes[3];
+  const u8 *kinds = tapes[0], *nodes = tapes[4];
+  const u32 *offsets = (const u32 *)tapes[1], *values = (const u32 *)tapes[2], *tokens = (const u32 *)tapes[5];
+  const u32 *lhs = (const u32 *)tapes[6], *rhs = (const u32 *)tapes[7], *extra = (const u32 *)tapes[8];
+  u64 i, j, len, list, tokens_len, nodes_len, extra_len;
+  tokens_len = tape_len(kinds);
+  nodes_len  = tape_len(nodes);
+  extra_len  = tape_len(extra);
+  if (tape_len(offsets) != tokens_len || tape_len(values) != tokens_len || tape_len(tokens) != nodes_len ||
+      tape_len(lhs) != nodes_len || tape_len(rhs) != nodes_len || !nodes_len || nodes[0] != AST_ROOT) {
+    return false;
+  }
+  for (i = 0; i < tokens_len; i++) {
+    if (kinds[i] >= TKN_EOF || offsets[i] > src_len) return false;
+    switch (kinds[i]) {
+      case TKN_IDEN: {
+        if (values[i] == SYM_NONE || values[i] >= names) return false;
+        len = name[values[i]].len;
+      } break;
+      case TKN_INT: len = values[i]; break;
+      case TKN_LPAR: {
+        if (values[i] >= tokens_len || kinds[values[i]] != TKN_RPAR) return false;
+        len = 1;
+      } break;
+      default: len = token_fixed_len(kinds[i]);
+    }
+    if (len > src_len - offsets[i]) return false;
+  }
+  for (i = 0; i < nodes_len; i++) {
+    if (tokens[i] != AST_NO_TOKEN && tokens[i] >= tokens_len) return false;
+    list = ~0ul; /* the node has no list */
+    switch (nodes[i]) {
+      case AST_ROOT: list = lhs[i]; break;
+      case AST_IDEN: if (lhs[i] >= names) return false; break;
+      case AST_INT:  if (lhs[i] + 2ul > extra_len) return false; break;
+      case AST_DEF_CON:
+      case AST_DEF_VAR: if (lhs[i] >= names || rhs[i] >= nodes_len) return false; break;
+      case AST_GROUP: if (lhs[i] >= nodes_len) return false; break;
+      case AST_FN: {
+        if (lhs[i] + 2ul > extra_len || rhs[i] >= nodes_len) return false;
+        if (extra[lhs[i]] != AST_NO_TOKEN && extra[lhs[i]] >= tokens_len) return false;
+        list = lhs[i] + 1;
+      } break;
+      case AST_PARAM: if (lhs[i] >= names || rhs[i] >= tokens_len) return false; break;
+      case AST_CALL: {
+        if (lhs[i] >= names) return false;
+        list = rhs[i];
+      } break;
+      case AST_SYSCALL: list = rhs[i]; break;
+      case AST_BINARY: if (lhs[i] >= nodes_len || rhs[i] >= nodes_len) return false; break;
+      default: return false;
+    }
+    if (list == ~0ul) continue;
+    if (list >= extra_len || extra[list] > extra_len - list - 1) return false;
+    for (j = 1; j <= extra[list]; j++) {
+      if (extra[list + j] >= nodes_len) return false;
+    }
+  }
+  return true;
+}
+
+/* maps the cache file at 'path' as the lexer and the parser of 'module', false when it's missing or not for
+ * its source. the mapping is private and writable, so the tapes could even be changed, the file never is */
+u64
+module_cache_load(struct module *module, const char *path) {
+  const struct module_cache *cache;
+  struct tape_header *h;
+  struct module_name *names;
+  struct string name;
+  struct stat st;
+  u8 *file, *tapes[MODULE_CACHE_TAPES];
+  u64 fd, i;
+  fd = open(path, O_RDONLY, 0);
+  if (is_neg(fd)) return false;
+  file = MAP_FAILED;
+  if (!is_neg(fstat(fd, &st)) && st.st_size >= sizeof (struct module_cache)) {
+    file = mmap(0, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  (void)close(fd);
+  if (file == MAP_FAILED) return false;
+  cache = (const struct module_cache *)file;
+  if (cache->magic != MODULE_CACHE_MAGIC || cache->compiler != caches.compiler || cache->hash != module->hash ||
+      cache->size != st.st_size) {
+    (void)munmap(file, st.st_size);
+    return false;
+  }
+  for (i = 0; i < MODULE_CACHE_TAPES; i++) {
+    h = (struct tape_header *)(file + cache->tapes[i]);
+    if (cache->tapes[i] % 8 || cache->tapes[i] > st.st_size - sizeof (struct tape_header) || h->flags != TAPE_STATIC ||
+        h->typ != module_cache_typs[i] || h->cap > st.st_size - cache->tapes[i] - sizeof (struct tape_header) ||
+        h->len > h->cap / h->typ) {
+      (void)munmap(file, st.st_size);
+      return false;
+    }
+    tapes[i] = (u8 *)(h + 1);
+  }
+  names = (struct module_name *)tapes[3];
+  for (i = SYM_NONE + 1; i < tape_len(names); i++) {
+    if (names[i].offset > module->src.data.len || names[i].len > module->src.data.len - names[i].offset) {
+      (void)munmap(file, st.st_size);
+      return false;
+    }
+  }
+  if (!module_cache_check(tapes, tape_len(names), module->src.data.len)) {
+    (void)munmap(file, st.st_size);
+    return false;
+  }
+  /* interned in the same order they were, so every name gets the id it had */
+  for (i = SYM_NONE + 1; i < tape_len(names); i++) {
+    name.buf = module->src.data.buf + names[i].offset;
+    name.len = names[i].len;
+    if (interner_intern(&module->names, &name) != i) {
+      /* the names aren't unique, the lexer starts over on a clean interner */
+      (void)interner_destroy(&module->names);
+      module->names = interner_make();
+      (void)munmap(file, st.st_size);
+      return false;
+    }
+  }
+  module->lexer.kinds   = tapes[0];
+  module->lexer.offsets = (u32 *)tapes[1];
+  module->lexer.values  = (u32 *)tapes[2];
+  module->lexer.src     = &module->src;
+  module->lexer.names   = &module->names;
+  module->lexer.pos     = 0;
+  module->parser.ast.kinds  = tapes[4];
+  module->parser.ast.tokens = (u32 *)tapes[5];
+  module->parser.ast.lhs    = (u32 *)tapes[6];
+  module->parser.ast.rhs    = (u32 *)tapes[7];
+  module->parser.ast.extra  = (u32 *)tapes[8];
+  module->parser.lexer    = &module->lexer;
+  module->parser.prv_node = 0;
+  return true;
+}
+
+/* a module whose source didn't change since the last build is mapped from its cache, skipping the lexer and
+ * the parser. stdin is cached like any file, under the path '-', and its content decides whether it's a hit */
+static void
+module_front_end(void *ctx, u64 index, u64 worker) {
+  struct module *module = (struct module *)ctx + index;
+  char path[PATH_MAX];
+  u64 is_cached, len;
+  module->names = interner_make();
+  is_cached = cache_path(path, sizeof (path), hash_bytes(module->src.file_path.buf, module->src.file_path.len), ".ast");
+  if (!is_cached || !module_cache_load(module, path)) {
+    module->lexer  = source_to_lexer(&module->src, &module->names);
+    module->parser = lexer_to_parser(&module->lexer);
+    if (is_cached) (void)module_cache_save(module, path); /* a read-only directory just means there's no cache */
+  }
+  len = tape_len(module->names.names);
+  module->syms = tape_chunk_grow(&module_workers[worker].syms, len, u32);
+  assert(module->syms != 0, "couldn't make module symbol table");
+  source_done[index] = true;
+  futex_wake(&source_done[index]);
+}
+
+/* lexes and parses every module on 'pool', then maps their names to 'names' */
+void
+modules_front_end(struct module *modules, u64 amount, struct pool *pool, struct interner *names) {
+  u64 i, j, len, *done;
+  done = tape_make(sizeof (u64), amount);
+  assert(done && tape_grow(done, amount, u64), "couldn't make module table");
+  (void)mem_set(done, 0, amount * sizeof (u64));
+  if (!module_syms) module_syms = tape_make_shared(sizeof (u32), 0, 0);
+  module_workers = tape_make(sizeof (struct module_worker), pool->amount);
+  assert(module_syms && module_workers && tape_grow(module_workers, pool->amount, struct module_worker),
+         "couldn't make module symbol tables");
+  for (i = 0; i < pool->amount; i++) module_workers[i].syms = tape_chunk_make(module_syms);
+  source_done = done;
+  pool_run(pool, module_front_end, modules, amount);
+  source_done = 0;
+  (void)tape_destroy(done);
+  (void)tape_destroy(module_workers);
+  module_workers = 0;
+  for (i = 0; i < amount; i++) {
+    len = tape_len(modules[i].names.names);
+    modules[i].syms[SYM_NONE] = SYM_NONE;
+    for (j = SYM_NONE + 1; j < len; j++) modules[i].syms[j] = interner_intern(names, &modules[i].names.names[j]);
+  }
+}
+
+/* linear scan register allocation over the IR of one function. the code is straight-line, so the interval of a
+ * value goes from its definition to its last use and the values already come sorted by where they start.
+ *
+ * stark to stark calls pass the first 'REGALLOC_ARGS_MAX' arguments on 'regalloc_args', push the rest right to
+ * left and return on rax. rbx, rbp and r12 to r15 survive a call, every other register may be clobbered by it.
+ * '__syscall__' is lowered inline, its arguments go on 'regalloc_syscall_args' and the kernel clobbers rax, rcx
+ * and r11. loading the arguments overwrites their registers too, so only the callee-saved ones survive it.
+ * system v is left for the boundary with foreign code. rcx and rdx are never allocated, they're left as
+ * scratch for the code generator, 'div' and the shift counts, and so is rax, except for a value that's returned
+ * right after it's made */
+#define REGALLOC_MEMORY 16 /* spilled, or a parameter that came on the stack */
+#define REGALLOC_CONST  17 /* materialized again on every use */
+#define REGALLOC_NONE   18 /* the value is never used */
+#define REGALLOC_ARGS_MAX 6
+#define REGALLOC_SYSCALL_ARGS 7
+#define REGALLOC_CALLER_SAVED (1 << X64_RSI | 1 << X64_RDI | 1 << X64_R8 | 1 << X64_R9 | 1 << X64_R10 | 1 << X64_R11)
+#define REGALLOC_CALLEE_SAVED (1 << X64_RBX | 1 << X64_R12 | 1 << X64_R13 | 1 << X64_R14 | 1 << X64_R15)
+#define REGALLOC_SYSCALL_CLOBBERED (1 << X64_RAX | 1 << X64_RDI | 1 << X64_RSI | 1 << X64_RDX | 1 << X64_R10 | 1 << X64_R8 | \
+                                    1 << X64_R9 | 1 << X64_RCX | 1 << X64_R11)
+
+static const u8 regalloc_args[REGALLOC_ARGS_MAX] = { X64_RDI, X64_RSI, X64_R8, X64_R9, X64_R10, X64_R11 };
+static const u8 regalloc_syscall_args[REGALLOC_SYSCALL_ARGS] = { X64_RAX, X64_RDI, X64_RSI, X64_RDX, X64_R10, X64_R8, X64_R9 };
+
+struct regalloc {
+  u32 *ends;  /* last use of every value, the value itself when it has none */
+  u32 *calls;    /* how many calls come before every value */
+  u32 *syscalls; /* how many syscalls come before every value */
+  u8  *regs;  /* register of every value, or one of the 'REGALLOC_*' locations */
+  u8  *hints; /* register that would save a move for every value, or 'REGALLOC_NONE' */
+  u64 *disps; /* rbp displacement of every 'REGALLOC_MEMORY' value */
+  u64 saved;  /* callee-saved registers the function uses, one bit each */
+  u64 spills; /* stack slots below the saved registers */
+  u64 frame;  /* rbp is needed to reach memory values */
+};
+
+struct regalloc
+regalloc_make(void) {
+  struct regalloc ra;
+  ra.ends  = tape_make(sizeof (u32), 0);
+  ra.calls = tape_make(sizeof (u32), 0);
+  ra.syscalls = tape_make(sizeof (u32), 0);
+  ra.regs  = tape_make(sizeof (u8),  0);
+  ra.hints = tape_make(sizeof (u8),  0);
+  ra.disps = tape_make(sizeof (u64), 0);
+  assert(ra.ends && ra.calls && ra.syscalls && ra.regs && ra.hints && ra.disps, "couldn't make register allocation buffers");
+  ra.saved  = 0;
+  ra.spills = 0;
+  ra.frame  = false;
+  return ra;
+}
+
+u64
+regalloc_destroy(struct regalloc *ra) {
+  u64 res;
+  if (!ra || !ra->ends) return false;
+  res  = tape_destroy(ra->ends);
+  res &= tape_destroy(ra->calls);
+  res &= tape_destroy(ra->syscalls);
+  res &= tape_destroy(ra->regs);
+  res &= tape_destroy(ra->hints);
+  res &= tape_destroy(ra->disps);
+  ra->ends  = 0;
+  ra->calls = 0;
+  ra->syscalls = 0;
+  ra->regs  = 0;
+  ra->hints = 0;
+  ra->disps = 0;
+  return res;
+}
+
+/* 'value' is read at 'at', where being on 'hint' would save a move */
+static void
+regalloc_use(struct regalloc *ra, u64 value, u64 at, u64 hint) {
+  ra->ends[value] = at;
+  if (ra->hints[value] == REGALLOC_NONE && (REGALLOC_CALLER_SAVED >> hint & 1)) ra->hints[value] = hint;
+}
+
+static void
+regalloc_uses(struct regalloc *ra, const struct ir *ir, u64 at) {
+  const u8 *hints;
+  u64 i, list, amount;
+  enum ir_op op = ir->ops[at];
+  if (op == IR_COPY || op == IR_RET || IR_IS_BINARY(op)) regalloc_use(ra, ir->a[at], at, REGALLOC_NONE);
+  if (IR_IS_BINARY(op)) regalloc_use(ra, ir->b[at], at, REGALLOC_NONE);
+  if (op == IR_CALL || op == IR_SYSCALL) {
+    hints  = op == IR_CALL ? regalloc_args : regalloc_syscall_args;
+    amount = op == IR_CALL ? REGALLOC_ARGS_MAX : REGALLOC_SYSCALL_ARGS;
+    list   = ir->b[at];
+    for (i = 0; i < ir_list_len(ir, list); i++) {
+      regalloc_use(ra, ir_list_get(ir, list, i), at, i < amount ? hints[i] : REGALLOC_NONE);
+    }
+  }
+}
+
+/* the value with the furthest last use on any of the 'regs', or 'none' */
+static u64
+regalloc_furthest(const struct regalloc *ra, const u64 *owners, u64 regs, u64 none) {
+  u64 reg, furthest = none;
+  for (reg = 0; reg < 16; reg++) {
+    if (!(regs >> reg & 1) || owners[reg] == none) continue;
+    if (furthest == none || ra->ends[owners[reg]] > ra->ends[furthest]) furthest = owners[reg];
+  }
+  return furthest;
+}
+
+/* true when nothing that needs code comes between 'value' and the return that reads it */
+static u64
+regalloc_is_returned(const struct regalloc *ra, const struct ir *ir, u64 value) {
+  u64 i;
+  if (ir->ops[value] == IR_PARAM || ir->ops[ra->ends[value]] != IR_RET) return false;
+  for (i = value + 1; i < ra->ends[value]; i++) {
+    if (ir->ops[i] != IR_NOP && ir->ops[i] != IR_CONST) return false;
+  }
+  return true;
+}
+
+/* a value that lives through a call can only be on a callee-saved register, and through a syscall on none of
+ * the registers its arguments are loaded on or the kernel clobbers */
+static u64
+regalloc_allowed(const struct regalloc *ra, u64 value) {
+  u64 end = ra->ends[value];
+  if (ra->calls[end] != ra->calls[value + 1]) return REGALLOC_CALLEE_SAVED;
+  if (ra->syscalls[end] != ra->syscalls[value + 1]) return (REGALLOC_CALLER_SAVED | REGALLOC_CALLEE_SAVED) & ~REGALLOC_SYSCALL_CLOBBERED;
+  return REGALLOC_CALLER_SAVED | REGALLOC_CALLEE_SAVED;
+}
+
+static void
+regalloc_spill(struct regalloc *ra, u64 value) {
+  ra->regs[value]  = REGALLOC_MEMORY;
+  ra->disps[value] = ra->spills++;
+  ra->frame        = true;
+}
+
+void
+regalloc_run(struct regalloc *ra, const struct ir *ir) {
+  u64 owners[16], i, reg, free, calls, syscalls, victim, saved, len = ir_len(ir);
+  enum ir_op op;
+  assert(tape_clear(ra->ends) && tape_clear(ra->calls) && tape_clear(ra->syscalls) && tape_clear(ra->regs) && tape_clear(ra->hints) && tape_clear(ra->disps), "couldn't clear register allocation buffers");
+  assert(tape_grow(ra->ends, len, u32) && tape_grow(ra->calls, len, u32) && tape_grow(ra->syscalls, len, u32) && tape_grow(ra->regs, len, u8) && tape_grow(ra->hints, len, u8) && tape_grow(ra->disps, len, u64), "exceeded maximum register allocation capacity");
+  ra->saved  = 0;
+  ra->spills = 0;
+  ra->frame  = false;
+  for (i = 0, calls = 0, syscalls = 0; i < len; i++) {
+    ra->ends[i]     = i;
+    ra->calls[i]    = calls;
+    ra->syscalls[i] = syscalls;
+    ra->regs[i]  = REGALLOC_NONE;
+    ra->hints[i] = ir->ops[i] == IR_PARAM && ir->a[i] < REGALLOC_ARGS_MAX ? regalloc_args[ir->a[i]] : REGALLOC_NONE;
+    calls    += ir->ops[i] == IR_CALL;
+    syscalls += ir->ops[i] == IR_SYSCALL;
+  }
+  for (i = 0; i < len; i++) regalloc_uses(ra, ir, i);
+  for (reg = 0; reg < 16; reg++) owners[reg] = len;
+  for (i = 0; i < len; i++) {
+    op = ir->ops[i];
+    if (op == IR_NOP || op == IR_RET || ra->ends[i] == i) continue;
+    if (op == IR_CONST) {
+      ra->regs[i] = REGALLOC_CONST;
+      continue;
+    }
+    if (op == IR_PARAM && ir->a[i] >= REGALLOC_ARGS_MAX) {
+      ra->regs[i]  = REGALLOC_MEMORY;
+      ra->disps[i] = 16 + (ir->a[i] - REGALLOC_ARGS_MAX) * 8;
+      ra->frame    = true;
+      continue;
+    }
+    if (regalloc_is_returned(ra, ir, i)) {
+      ra->regs[i] = X64_RAX;
+      continue;
+    }
+    for (reg = 0; reg < 16; reg++) {
+      if (owners[reg] != len && ra->ends[owners[reg]] <= i) owners[reg] = len;
+    }
+    free = regalloc_allowed(ra, i);
+    for (reg = 0; reg < 16; reg++) {
+      if (owners[reg] != len) free &= ~(1ul << reg);
+    }
+    if (ra->hints[i] != REGALLOC_NONE && (free >> ra->hints[i] & 1)) {
+      reg = ra->hints[i];
+    } else if (free) {
+      if (free & REGALLOC_CALLER_SAVED) free &= REGALLOC_CALLER_SAVED;
+      for (reg = 0; !(free >> reg & 1); reg++);
+    } else {
+      /* the value that's needed the furthest away goes to memory */
+      victim = regalloc_furthest(ra, owners, regalloc_allowed(ra, i), len);
+      if (victim == len || ra->ends[victim] <= ra->ends[i]) {
+        regalloc_spill(ra, i);
+        continue;
+      }
+      reg = ra->regs[victim];
+      regalloc_spill(ra, victim);
+    }
+    ra->regs[i] = reg;
+    owners[reg] = i;
+    if (REGALLOC_CALLEE_SAVED >> reg & 1) ra->saved |= 1ul << reg;
+  }
+  /* spill slots go below the saved registers, which are only known now */
+  for (reg = 0, saved = 0; reg < 16; reg++) saved += ra->saved >> reg & 1;
+  for (i = 0; i < len; i++) {
+    if (ra->regs[i] != REGALLOC_MEMORY || (ir->ops[i] == IR_PARAM && ir->a[i] >= REGALLOC_ARGS_MAX)) continue;
+    ra->disps[i] = 0 - (saved + ra->disps[i] + 1) * 8;
+  }
+}
+
+/* function code cache. all the code generated for a function comes from its IR, once every call is taken as the
+ * name and the parameter amount of the callee, so the code of every function is kept keyed by a hash of that,
+ * on a file of the cache directory for the source of its module. a function whose IR hashes the same as on the
+ * last build gets its code copied from there, skipping the register allocator and the encoder. the calls are
+ * the only part of the code that depends on where the rest went, so the cache keeps where their rel32 are and
+ * they're linked like any other. fasm output can't come from cached code, so it doesn't use it */
+#define FNCACHE_MAGIC 0x00646f6372617473ul /* "starcod" */
+
+struct fncache_file {
+  u64 magic;
+  u64 compiler; /* 'caches.compiler' of the starc that wrote it */
+  u64 size;  /* of the whole file */
+  u64 fns;   /* amount of 'struct fncache_fn' right after the header */
+  u64 slots; /* amount of u32 slots after the functions, a power of two. open addressing on the hashes, each
+              * slot is the index of a function plus one, 0 when empty */
+};
+
+struct fncache_fn {
+  u64 hash;
+  u64 code;      /* offset from the header */
+  u64 len;
+  u64 calls;     /* offset from the header of the u32 offset of the rel32 of every call, in IR order */
+  u64 calls_len;
+};
+
+/* the cache of the last build, read while the one of this build is made */
+struct fncache {
+  const struct fncache_file *old;
+  struct fncache_fn *fns; /* offsets on 'code' and 'calls' */
+  u8  *code;
+  u32 *calls;
+  u64 *key;   /* words that are hashed for a function */
+  u32 *rel32; /* offsets of the rel32 of the function being kept */
+};
+
+struct fncache
+fncache_make(void) {
+  struct fncache fc;
+  fc.old   = 0;
+  fc.fns   = tape_make(sizeof (struct fncache_fn), 0);
+  fc.code  = tape_make(sizeof (u8),  0);
+  fc.calls = tape_make(sizeof (u32), 0);
+  fc.key   = tape_make(sizeof (u64), 0);
+  fc.rel32 = tape_make(sizeof (u32), 0);
+  assert(fc.fns && fc.code && fc.calls && fc.key && fc.rel32, "couldn't make code cache buffers");
+  return fc;
+}
+
+u64
+fncache_destroy(struct fncache *fc) {
+  u64 res;
+  if (!fc || !fc->fns) return false;
+  res  = tape_destroy(fc->fns);
+  res &= tape_destroy(fc->code);
+  res &= tape_destroy(fc->calls);
+  res &= tape_destroy(fc->key);
+  res &= tape_destroy(fc->rel32);
+  if (fc->old) res &= munmap((void *)fc->old, fc->old->size) == 0;
+  fc->old   = 0;
+  fc->fns   = 0;
+  fc->code  = 0;
+  fc->calls = 0;
+  fc->key   = 0;
+  fc->rel32 = 0;
+  return res;
+}
+
+/* maps the cache at 'path' as the one of the last build, which is fine to be missing */
+void
+fncache_begin(struct fncache *fc, const char *path) {
+  const struct fncache_file *file;
+  struct stat st;
+  u64 fd;
+  assert(tape_clear(fc->fns) && tape_clear(fc->code) && tape_clear(fc->calls), "couldn't clear code cache buffers");
+  fd = open(path, O_RDONLY, 0);
+  if (is_neg(fd)) return;
+  file = MAP_FAILED;
+  if (!is_neg(fstat(fd, &st)) && st.st_size >= sizeof (struct fncache_file)) {
+    file = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  (void)close(fd);
+  if (file == MAP_FAILED) return;
+  if (file->magic != FNCACHE_MAGIC || file->compiler != caches.compiler || file->size != st.st_size ||
+      file->fns > st.st_size / sizeof (struct fncache_fn) ||
+      file->slots > st.st_size / sizeof (u32) || (file->slots & (file->slots - 1)) ||
+      sizeof (struct fncache_file) + file->fns * sizeof (struct fncache_fn) + file->slots * sizeof (u32) > st.st_size) {
+    (void)munmap((void *)file, st.st_size);
+    return;
+  }
+  fc->old = file;
+}
+
+/* the function of the last build that hashed to 'hash', 0 when there's none */
+const struct fncache_fn *
+fncache_find(const struct fncache *fc, u64 hash) {
+  const struct fncache_fn *fns;
+  const u32 *slots;
+  const struct fncache_file *file = fc->old;
+  u64 i, mask, n;
+  if (!file || !file->slots) return 0;
+  fns   = (const struct fncache_fn *)(file + 1);
+  slots = (const u32 *)(fns + file->fns);
+  mask  = file->slots - 1;
+  for (i = hash & mask, n = 0; slots[i] && n < file->slots; i = (i + 1) & mask, n++) {
+    if (slots[i] > file->fns || fns[slots[i] - 1].hash != hash) continue;
+    fns += slots[i] - 1;
+    if (fns->code > file->size || fns->len > file->size - fns->code || fns->calls % 4 || fns->calls > file->size ||
+        fns->calls_len > (file->size - fns->calls) / sizeof (u32)) return 0;
+    return fns;
+  }
+  return 0;
+}
+
+/* keeps 'len' bytes of 'code' for the function, 'calls' are the offsets of its rel32 from 'code' */
+void
+fncache_add(struct fncache *fc, u64 hash, const u8 *code, u64 len, const u32 *calls, u64 calls_len) {
+  struct fncache_fn *fn = tape_push(fc->fns, struct fncache_fn);
+  u8  *at_code  = tape_grow(fc->code, len, u8);
+  u32 *at_calls = tape_grow(fc->calls, calls_len, u32);
+  assert(fn && (at_code || !len) && (at_calls || !calls_len), "exceeded maximum code cache capacity");
+  fn->hash      = hash;
+  fn->code      = at_code ? at_code - fc->code : 0;
+  fn->len       = len;
+  fn->calls     = at_calls ? at_calls - fc->calls : 0;
+  fn->calls_len = calls_len;
+  if (len) (void)mem_copy(at_code, code, len);
+  if (calls_len) (void)mem_copy(at_calls, calls, calls_len * sizeof (u32));
+}
+
+/* writes the functions kept since 'fncache_begin' to 'path', through a rename like the other caches. the cache
+ * of the last build is dropped */
+u64
+fncache_end(struct fncache *fc, const char *path) {
+  struct fncache_file *file;
+  struct fncache_fn *fns;
+  u32 *slots;
+  u8 *image;
+  u64 i, j, amount, size, slots_amount, calls, res;
+  if (fc->old) (void)munmap((void *)fc->old, fc->old->size);
+  fc->old = 0;
+  amount = tape_len(fc->fns);
+  if (!amount) return true; /* modules with only constants don't get one */
+  for (slots_amount = 1; slots_amount < amount * 2; slots_amount *= 2);
+  calls = (sizeof (struct fncache_file) + amount * sizeof (struct fncache_fn) + slots_amount * sizeof (u32) + tape_len(fc->code) + 3) & ~3ul;
+  size  = calls + tape_len(fc->calls) * sizeof (u32);
+  image = tape_make(sizeof (u8), 0);
+  if (!image || !tape_grow(image, size, u8)) return false;
+  (void)mem_set(image, 0, size);
+  file  = (struct fncache_file *)image;
+  fns   = (struct fncache_fn *)(file + 1);
+  slots = (u32 *)(fns + amount);
+  file->magic    = FNCACHE_MAGIC;
+  file->compiler = caches.compiler;
+  file->size     = size;
+  file->fns      = amount;
+  file->slots    = slots_amount;
+  for (i = 0; i < amount; i++) {
+    fns[i] = fc->fns[i];
+    fns[i].code  += (u8 *)(slots + slots_amount) - image;
+    fns[i].calls  = calls + fns[i].calls * sizeof (u32);
+    for (j = fns[i].hash & (slots_amount - 1); slots[j]; j = (j + 1) & (slots_amount - 1));
+    slots[j] = i + 1;
+  }
+  (void)mem_copy(slots + slots_amount, fc->code, tape_len(fc->code));
+  (void)mem_copy(image + calls, fc->calls, tape_len(fc->calls) * sizeof (u32));
+  res = cache_write(path, image, size);
+  (void)tape_destroy(image);
+  return res;
+}
+
+/* compile-time evaluation of the module-scope constants. the value expression of a constant is compiled to a
+ * small stack bytecode and run right away, the result is kept so every constant is only evaluated once. a
+ * constant that's met again while it's still being evaluated is defined in terms of itself */
+enum consteval_op {
+  CONSTEVAL_PUSH = 0, /* pushes the operand */
+  CONSTEVAL_LOAD,     /* pushes the value of the constant defined by the operand */
+  CONSTEVAL_BINARY    /* pops 'y' and 'x' and pushes 'x op y', the operand is the 'enum ir_op' */
+};
+
+enum consteval_state {
+  CONSTEVAL_UNSEEN = 0,
+  CONSTEVAL_BUSY,
+  CONSTEVAL_DONE
+};
+
+struct consteval {
+  u8  *ops;
+  u64 *operands;
+  u32 *nodes;  /* node of every instruction, for the errors */
+  u64 *stack;
+  u64 *values; /* value of every constant, indexed by symbol id */
+  u8  *states; /* 'enum consteval_state' of every constant, indexed by symbol id */
+};
+
+/* code generation. every function is lowered to the IR, optimized, given registers and then emitted */
+struct codegen {
+  struct x64 x64;
+  struct ir ir;
+  struct regalloc ra;
+  struct consteval ce;
+  struct fncache fc;
+  u64 is_cached;         /* whether 'fc' is used for the module being generated */
+  struct module *modules;
+  struct module *module; /* module being lowered, 'ast' and 'lexer' are its own */
+  const struct ast *ast;
+  struct lexer *lexer;
+  u32 *defs;         /* module-scope definition of every symbol, indexed by symbol id, 0 when undefined */
+  u32 *def_modules;  /* module of every definition, indexed by symbol id */
+  u32 *labels;       /* label of every module-scope function, indexed by symbol id */
+  u64 fn;            /* function being lowered */
+};
+
+static void
+codegen_enter(struct codegen *cg, u64 module) {
+  cg->module = &cg->modules[module];
+  cg->ast    = &cg->module->parser.ast;
+  cg->lexer  = &cg->module->lexer;
+}
+
+/* symbol id on the whole build of the name on 'node' */
+static u64
+codegen_sym(struct codegen *cg, u64 node) {
+  return cg->module->syms[cg->ast->lhs[node]];
+}
+
+/* whether the module-scope symbol 'sym' is a function, it may be from another module */
+static u64
+codegen_is_fn(struct codegen *cg, u64 sym) {
+  const struct ast *ast = &cg->modules[cg->def_modules[sym]].parser.ast;
+  return ast->kinds[ast->rhs[cg->defs[sym]]] == AST_FN;
+}
+
+static struct token
+codegen_error_begin(struct codegen *cg, u64 node) {
+  struct token tok = lexer_token(cg->lexer, cg->ast->tokens[node]);
+  token_error_begin(cg->lexer, &tok);
+  return tok;
+}
+
+static void
+codegen_error(struct codegen *cg, u64 node, const char *msg) {
+  struct token tok = codegen_error_begin(cg, node);
+  io_append_cstr(msg);
+  token_error_end(cg->lexer, &tok);
+}
+
+static const struct string *
+codegen_name(struct codegen *cg, u64 node) {
+  return interner_name(cg->lexer->names, cg->ast->lhs[node]);
+}
+
+/* IR operator of a binary expression */
+static enum ir_op
+codegen_binary_op(struct codegen *cg, u64 node) {
+  switch (cg->lexer->kinds[cg->ast->tokens[node]]) {
+    case TKN_ADD:     return IR_ADD;
+    case TKN_SUB:     return IR_SUB;
+    case TKN_MUL:     return IR_MUL;
+    case TKN_DIV:     return IR_DIV;
+    case TKN_SHL:     return IR_SHL;
+    case TKN_SHR:     return IR_SHR;
+    case TKN_BIT_AND: return IR_AND;
+    case TKN_BIT_OR:  return IR_OR;
+    default: assert(false, "codegen_binary_op: unknown operator"); return IR_NOP;
+  }
+}
+
+struct consteval
+consteval_make(u64 syms) {
+  struct consteval ce;
+  ce.ops      = tape_make(sizeof (u8),  0);
+  ce.operands = tape_make(sizeof (u64), 0);
+  ce.nodes    = tape_make(sizeof (u32), 0);
+  ce.stack    = tape_make(sizeof (u64), 0);
+  ce.values   = tape_make(sizeof (u64), syms);
+  ce.states   = tape_make(sizeof (u8),  syms);
+  assert(ce.ops && ce.operands && ce.nodes && ce.stack && ce.values && ce.states, "couldn't make constant evaluation buffers");
+  assert(tape_grow(ce.values, syms, u64) && tape_grow(ce.states, syms, u8), "couldn't make constant tables");
+  (void)mem_set(ce.states, CONSTEVAL_UNSEEN, syms);
+  return ce;
+}
+
+u64
+consteval_destroy(struct consteval *ce) {
+  u64 res;
+  if (!ce || !ce->ops) return false;
+  res  = tape_destroy(ce->ops);
+  res &= tape_destroy(ce->operands);
+  res &= tape_destroy(ce->nodes);
+  res &= tape_destroy(ce->stack);
+  res &= tape_destroy(ce->values);
+  res &= tape_destroy(ce->states);
+  ce->ops      = 0;
+  ce->operands = 0;
+  ce->nodes    = 0;
+  ce->stack    = 0;
+  ce->values   = 0;
+  ce->states   = 0;
+  return res;
+}
+
+static u64 consteval_constant(struct codegen *cg, u64 sym, u64 node);
+
+static void
+consteval_emit(struct codegen *cg, enum consteval_op op, u64 operand, u64 node) {
+  u8  *o = tape_push(cg->ce.ops, u8);
+  u64 *a = tape_push(cg->ce.operands, u64);
+  u32 *n = tape_push(cg->ce.nodes, u32);
+  assert(o && a && n, "exceeded maximum constant bytecode capacity");
+  *o = op;
+  *a = operand;
+  *n = node;
+}
+
+static void
+consteval_compile(struct codegen *cg, u64 node) {
+  u64 sym;
+  switch (cg->ast->kinds[node]) {
+    case AST_INT:   consteval_emit(cg, CONSTEVAL_PUSH, ast_int_value(cg->ast, node), node); break;
+    case AST_GROUP: consteval_compile(cg, cg->ast->lhs[node]);                              break;
+    case AST_IDEN: {
+      sym = codegen_sym(cg, node);
+      if (!cg->defs[sym]) codegen_error(cg, node, "undeclared symbol");
+      if (codegen_is_fn(cg, sym)) codegen_error(cg, node, "functions can only be called");
+      consteval_emit(cg, CONSTEVAL_LOAD, sym, node);
+    } break;
+    case AST_BINARY: {
+      consteval_compile(cg, cg->ast->lhs[node]);
+      consteval_compile(cg, cg->ast->rhs[node]);
+      consteval_emit(cg, CONSTEVAL_BINARY, codegen_binary_op(cg, node), node);
+    } break;
+    case AST_CALL:
+    case AST_SYSCALL: codegen_error(cg, node, "calls aren't constant expressions"); break;
+    default:          codegen_error(cg, node, "expression isn't constant");         break;
+  }
+}
+
+/* runs the bytecode from 'begin' to its end and returns the value left on the stack. the constants loaded on
+ * the way are compiled after 'end' and rolled back before the loop goes on, so 'end' stays the same */
+static u64
+consteval_run(struct codegen *cg, u64 begin) {
+  u64 i, x, y, *top, end = tape_len(cg->ce.ops);
+  for (i = begin; i < end; i++) {
+    switch (cg->ce.ops[i]) {
+      case CONSTEVAL_PUSH: x = cg->ce.operands[i];                                           break;
+      case CONSTEVAL_LOAD: x = consteval_constant(cg, cg->ce.operands[i], cg->ce.nodes[i]); break;
+      default: {
+        y = cg->ce.stack[tape_len(cg->ce.stack) - 1];
+        x = cg->ce.stack[tape_len(cg->ce.stack) - 2];
+        assert(tape_shrink(cg->ce.stack, 2), "consteval_run: stack underflow");
+        if (!ir_fold_binary(cg->ce.operands[i], x, y, &x)) codegen_error(cg, cg->ce.nodes[i], "division by zero on a constant expression");
+      } break;
+    }
+    top = tape_push(cg->ce.stack, u64);
+    assert(top != 0, "exceeded maximum constant evaluation stack");
+    *top = x;
+  }
+  x = cg->ce.stack[tape_len(cg->ce.stack) - 1];
+  assert(tape_pop(cg->ce.stack), "consteval_run: stack underflow");
+  return x;
+}
+
+/* value of the constant 'sym', 'node' is where it's used. the definition is compiled on its own module */
+static u64
+consteval_constant(struct codegen *cg, u64 sym, u64 node) {
+  struct token tok;
+  u64 mark, value, module = cg->module - cg->modules;
+  if (cg->ce.states[sym] == CONSTEVAL_DONE) return cg->ce.values[sym];
+  if (cg->ce.states[sym] == CONSTEVAL_BUSY) {
+    tok = codegen_error_begin(cg, node);
+    io_append_char('\'');
+    io_set_bold_white();
+    io_append(codegen_name(cg, node));
+    io_reset();
+    io_append_cstr("' is defined in terms of itself");
+    token_error_end(cg->lexer, &tok);
+  }
+  cg->ce.states[sym] = CONSTEVAL_BUSY;
+  mark = tape_mark(cg->ce.ops);
+  codegen_enter(cg, cg->def_modules[sym]);
+  consteval_compile(cg, cg->ast->rhs[cg->defs[sym]]);
+  value = consteval_run(cg, mark);
+  codegen_enter(cg, module);
+  assert(tape_rollback(cg->ce.ops, mark) && tape_rollback(cg->ce.operands, mark) && tape_rollback(cg->ce.nodes, mark), "couldn't roll back constant bytecode");
+  cg->ce.states[sym] = CONSTEVAL_DONE;
+  cg->ce.values[sym] = value;
+  return value;
+}
+
+static u64 codegen_lower(struct codegen *cg, u64 node);
+
+/* constants were already evaluated, so they're just immediates. the parameters are the first values of a
+ * function, so the value of a parameter is its index */
+static u64
+codegen_lower_identifier(struct codegen *cg, u64 node) {
+  u64 params, i, sym;
+  params = ast_fn_params(cg->ast, cg->fn);
+  for (i = 0; i < ast_list_len(cg->ast, params); i++) {
+    if (cg->ast->lhs[ast_list_get(cg->ast, params, i)] == cg->ast->lhs[node]) return i;
+  }
+  sym = codegen_sym(cg, node);
+  if (!cg->defs[sym]) codegen_error(cg, node, "undeclared symbol");
+  if (codegen_is_fn(cg, sym)) codegen_error(cg, node, "functions can only be called");
+  return ir_value_make(&cg->ir, IR_CONST, consteval_constant(cg, sym, node), 0);
+}
+
+static void
+codegen_arguments_count(struct codegen *cg, u64 node, u64 expected) {
+  struct token tok;
+  u64 found = ast_list_len(cg->ast, cg->ast->rhs[node]);
+  if (found == expected) return;
+  tok = codegen_error_begin(cg, node);
+  io_append_cstr("expected ");
+  io_append_u64(expected);
+  io_append_cstr(expected == 1 ? " argument, but found " : " arguments, but found ");
+  io_append_u64(found);
+  token_error_end(cg->lexer, &tok);
+}
+
+/* arguments are evaluated left to right, returns the IR list with their values */
+static u64
+codegen_lower_arguments(struct codegen *cg, u64 node) {
+  u64 args, list, i, value;
+  args = cg->ast->rhs[node];
+  list = ir_list_make(&cg->ir, ast_list_len(cg->ast, args));
+  for (i = 0; i < ast_list_len(cg->ast, args); i++) {
+    value = codegen_lower(cg, ast_list_get(cg->ast, args, i));
+    cg->ir.extra[list + 1 + i] = value;
+  }
+  return list;
+}
+
+static u64
+codegen_lower_call(struct codegen *cg, u64 node) {
+  u64 sym;
+  const struct ast *ast;
+  struct token tok;
+  sym = codegen_sym(cg, node);
+  if (!cg->defs[sym]) codegen_error(cg, node, "undeclared symbol");
+  if (!codegen_is_fn(cg, sym)) {
+    tok = codegen_error_begin(cg, node);
+    io_append_char('\'');
+    io_set_bold_white();
+    io_append(codegen_name(cg, node));
+    io_reset();
+    io_append_cstr("' isn't a function");
+    token_error_end(cg->lexer, &tok);
+  }
+  ast = &cg->modules[cg->def_modules[sym]].parser.ast;
+  codegen_arguments_count(cg, node, ast_list_len(ast, ast_fn_params(ast, ast->rhs[cg->defs[sym]])));
+  return ir_value_make(&cg->ir, IR_CALL, sym, codegen_lower_arguments(cg, node));
+}
+
+static u64
+codegen_lower_binary(struct codegen *cg, u64 node) {
+  u64 lhs, rhs;
+  lhs = codegen_lower(cg, cg->ast->lhs[node]);
+  rhs = codegen_lower(cg, cg->ast->rhs[node]);
+  return ir_value_make(&cg->ir, codegen_binary_op(cg, node), lhs, rhs);
+}
+
+/* returns the value of 'node' */
+static u64
+codegen_lower(struct codegen *cg, u64 node) {
+  switch (cg->ast->kinds[node]) {
+    case AST_INT:     return ir_value_make(&cg->ir, IR_CONST, ast_int_value(cg->ast, node), 0);
+    case AST_GROUP:   return codegen_lower(cg, cg->ast->lhs[node]);
+    case AST_IDEN:    return codegen_lower_identifier(cg, node);
+    case AST_CALL:    return codegen_lower_call(cg, node);
+    case AST_BINARY:  return codegen_lower_binary(cg, node);
+    case AST_SYSCALL: {
+      codegen_arguments_count(cg, node, 7);
+      return ir_value_make(&cg->ir, IR_SYSCALL, 0, codegen_lower_arguments(cg, node));
+    }
+    case AST_DEF_CON:
+    case AST_DEF_VAR: codegen_error(cg, node, "definitions inside functions aren't supported yet"); break;
+    case AST_FN:      codegen_error(cg, node, "nested functions aren't supported yet");             break;
+    default:          codegen_error(cg, node, "expression isn't supported by the backend yet");     break;
+  }
+  return 0;
+}
+
+/* register holding 'value', which is loaded into 'scratch' when it isn't on one */
+static u64
+codegen_read(struct codegen *cg, u64 value, u64 scratch) {
+  switch (cg->ra.regs[value]) {
+    case REGALLOC_CONST: {
+      /* zero is the common argument, 'xor' is the shortest way to it */
+      if (cg->ir.a[value]) x64_mov_ri(&cg->x64, scratch, cg->ir.a[value]);
+      else x64_alu_rr(&cg->x64, X64_XOR, scratch, scratch);
+    } return scratch;
+    case REGALLOC_MEMORY: x64_load(&cg->x64, scratch, X64_RBP, cg->ra.disps[value]);     return scratch;
+    default:              return cg->ra.regs[value];
+  }
+}
+
+static void
+codegen_move(struct codegen *cg, u64 dst, u64 value) {
+  u64 src = codegen_read(cg, value, dst);
+  if (src != dst) x64_mov_rr(&cg->x64, dst, src);
+}
+
+/* 'src' goes to wherever 'value' lives */
+static void
+codegen_write(struct codegen *cg, u64 value, u64 src) {
+  u64 dst = cg->ra.regs[value];
+  if (dst == REGALLOC_MEMORY) x64_store(&cg->x64, X64_RBP, cg->ra.disps[value], src);
+  else if (dst != REGALLOC_NONE && dst != src) x64_mov_rr(&cg->x64, dst, src);
+}
+
+/* register to register moves that behave as if all of them happened at once. a move waits while its
+ * destination still has to be read by another one, and when every move waits they're on a cycle, which is
+ * broken by parking one of the sources on rcx, which is never the destination of an argument */
+static void
+codegen_parallel_move(struct codegen *cg, u8 *dsts, u8 *srcs, u64 amount) {
+  u64 i, j, parked;
+  while (amount) {
+    for (i = 0; i < amount; i++) {
+      for (j = 0; j < amount && (j == i || srcs[j] != dsts[i]); j++);
+      if (j == amount) break;
+    }
+    if (i == amount) {
+      parked = srcs[0];
+      x64_mov_rr(&cg->x64, X64_RCX, parked);
+      for (j = 0; j < amount; j++) {
+        if (srcs[j] == parked) srcs[j] = X64_RCX;
+      }
+      continue;
+    }
+    x64_mov_rr(&cg->x64, dsts[i], srcs[i]);
+    amount--;
+    dsts[i] = dsts[amount];
+    srcs[i] = srcs[amount];
+  }
+}
+
+/* puts the first 'len' arguments of 'list' on 'regs', the ones that don't fit are pushed right to left before
+ * it. returns how many were pushed. constants and memory are loaded last since they don't read any register */
+static u64
+codegen_arguments(struct codegen *cg, u64 list, u64 len, const u8 *regs, u64 regs_amount) {
+  u8 dsts[REGALLOC_SYSCALL_ARGS], srcs[REGALLOC_SYSCALL_ARGS];
+  u64 i, value, amount = 0;
+  for (i = len; i > regs_amount; i--) x64_push(&cg->x64, codegen_read(cg, ir_list_get(&cg->ir, list, i - 1), X64_RAX));
+  for (i = 0; i < len && i < regs_amount; i++) {
+    value = ir_list_get(&cg->ir, list, i);
+    if (cg->ra.regs[value] >= REGALLOC_MEMORY || cg->ra.regs[value] == regs[i]) continue;
+    dsts[amount] = regs[i];
+    srcs[amount] = cg->ra.regs[value];
+    amount++;
+  }
+  codegen_parallel_move(cg, dsts, srcs, amount);
+  for (i = 0; i < len && i < regs_amount; i++) {
+    value = ir_list_get(&cg->ir, list, i);
+    if (cg->ra.regs[value] >= REGALLOC_MEMORY) codegen_move(cg, regs[i], value);
+  }
+  return len > regs_amount ? len - regs_amount : 0;
+}
+
+/* the parameters that came on registers go to the ones they were given */
+static void
+codegen_parameters(struct codegen *cg, u64 amount) {
+  u8 dsts[REGALLOC_ARGS_MAX], srcs[REGALLOC_ARGS_MAX];
+  u64 i, moves = 0;
+  for (i = 0; i < amount && i < REGALLOC_ARGS_MAX; i++) {
+    if (cg->ra.regs[i] == REGALLOC_MEMORY) x64_store(&cg->x64, X64_RBP, cg->ra.disps[i], regalloc_args[i]);
+    if (cg->ra.regs[i] >= REGALLOC_MEMORY || cg->ra.regs[i] == regalloc_args[i]) continue;
+    dsts[moves] = cg->ra.regs[i];
+    srcs[moves] = regalloc_args[i];
+    moves++;
+  }
+  codegen_parallel_move(cg, dsts, srcs, moves);
+}
+
+static void
+codegen_syscall(struct codegen *cg, u64 list) {
+  (void)codegen_arguments(cg, list, ir_list_len(&cg->ir, list), regalloc_syscall_args, REGALLOC_SYSCALL_ARGS);
+  x64_syscall(&cg->x64);
+}
+
+static void
+codegen_binary(struct codegen *cg, u64 value) {
+  struct x64 *x64 = &cg->x64;
+  u64 a = cg->ir.a[value], b = cg->ir.b[value], imm = cg->ir.a[b], dst;
+  u64 is_imm = cg->ra.regs[b] == REGALLOC_CONST && imm + 0x80000000 < 0x100000000;
+  enum ir_op op = cg->ir.ops[value];
+  /* computed right on the register of the value, unless that would clobber 'b' before it's read */
+  dst = cg->ra.regs[value] < REGALLOC_MEMORY && cg->ra.regs[value] != cg->ra.regs[b] ? cg->ra.regs[value] : X64_RAX;
+  switch (op) {
+    case IR_DIV: {
+      dst = X64_RAX;
+      codegen_move(cg, X64_RAX, a);
+      x64_alu_rr(x64, X64_XOR, X64_RDX, X64_RDX);
+      x64_div_r(x64, codegen_read(cg, b, X64_RCX));
+    } break;
+    case IR_SHL:
+    case IR_SHR: {
+      if (cg->ra.regs[b] == REGALLOC_CONST) {
+        codegen_move(cg, dst, a);
+        x64_shift_ri(x64, op == IR_SHL ? X64_SHL : X64_SHR, dst, imm);
+      } else {
+        codegen_move(cg, X64_RCX, b);
+        codegen_move(cg, dst, a);
+        x64_shift_cl(x64, op == IR_SHL ? X64_SHL : X64_SHR, dst);
+      }
+    } break;
+    case IR_MUL: {
+      codegen_move(cg, dst, a);
+      x64_imul_rr(x64, dst, codegen_read(cg, b, X64_RCX));
+    } break;
+    default: {
+      enum x64_alu alu = op == IR_ADD ? X64_ADD : op == IR_SUB ? X64_SUB : op == IR_AND ? X64_AND : X64_OR;
+      codegen_move(cg, dst, a);
+      if (is_imm) x64_alu_ri(x64, alu, dst, imm);
+      else x64_alu_rr(x64, alu, dst, codegen_read(cg, b, X64_RCX));
+    } break;
+  }
+  codegen_write(cg, value, dst);
+}
+
+static void
+codegen_return(struct codegen *cg, u64 value) {
+  u64 reg;
+  codegen_move(cg, X64_RAX, value);
+  if (cg->ra.spills) x64_alu_ri(&cg->x64, X64_ADD, X64_RSP, cg->ra.spills * 8);
+  for (reg = 16; reg--;) {
+    if (cg->ra.saved >> reg & 1) x64_pop(&cg->x64, reg);
+  }
+  if (cg->ra.frame) x64_pop(&cg->x64, X64_RBP);
+  x64_ret(&cg->x64);
+}
+
+static void
+codegen_emit(struct codegen *cg, u64 value) {
+  u64 pushed;
+  switch (cg->ir.ops[value]) {
+    case IR_NOP:
+    case IR_CONST:
+    case IR_PARAM: break; /* constants are materialized when used, the parameters at the start */
+    case IR_COPY:  codegen_write(cg, value, codegen_read(cg, cg->ir.a[value], X64_RAX)); break;
+    case IR_CALL: {
+      pushed = codegen_arguments(cg, cg->ir.b[value], ir_list_len(&cg->ir, cg->ir.b[value]), regalloc_args, REGALLOC_ARGS_MAX);
+      x64_call(&cg->x64, cg->labels[cg->ir.a[value]]);
+      if (pushed) x64_alu_ri(&cg->x64, X64_ADD, X64_RSP, pushed * 8);
+      codegen_write(cg, value, X64_RAX);
+    } break;
+    case IR_SYSCALL: {
+      codegen_syscall(cg, cg->ir.b[value]);
+      codegen_write(cg, value, X64_RAX);
+    } break;
+    case IR_RET: codegen_return(cg, cg->ir.a[value]); break;
+    default:     codegen_binary(cg, value);            break;
+  }
+}
+
+/* hash of the IR of the function, the calls go by the name and the parameter amount of the callee since its
+ * symbol id and label depend on the rest of the build */
+static u64
+codegen_hash(struct codegen *cg) {
+  const struct module *module;
+  const struct ast *ast;
+  const struct string *name;
+  u64 i, j, def, *key;
+  enum ir_op op;
+  assert(tape_clear(cg->fc.key), "couldn't clear code cache key");
+  for (i = 0; i < ir_len(&cg->ir); i++) {
+    op = cg->ir.ops[i];
+    assert((key = tape_grow(cg->fc.key, 3, u64)) != 0, "exceeded maximum code cache key size");
+    key[0] = op;
+    key[1] = op == IR_NOP || op == IR_SYSCALL ? 0 : cg->ir.a[i];
+    key[2] = IR_IS_BINARY(op) ? cg->ir.b[i] : 0;
+    if (op == IR_CALL) {
+      def    = cg->defs[cg->ir.a[i]];
+      module = &cg->modules[cg->def_modules[cg->ir.a[i]]];
+      ast    = &module->parser.ast;
+      name   = interner_name(&module->names, ast->lhs[def]);
+      key[1] = hash_bytes(name->buf, name->len);
+      key[2] = ast_list_len(ast, ast_fn_params(ast, ast->rhs[def]));
+    }
+    if (op != IR_CALL && op != IR_SYSCALL) continue;
+    for (j = 0; j < ir_list_len(&cg->ir, cg->ir.b[i]); j++) {
+      assert((key = tape_push(cg->fc.key, u64)) != 0, "exceeded maximum code cache key size");
+      *key = ir_list_get(&cg->ir, cg->ir.b[i], j);
+    }
+  }
+  return hash_bytes((const char *)cg->fc.key, tape_len(cg->fc.key) * sizeof (u64));
+}
+
+/* copies the code of the function from the cache of the last build, false when it isn't there. the rel32 of
+ * the calls go on the order of the IR, which is the order the code made them */
+static u64
+codegen_cached(struct codegen *cg, u64 label, u64 hash) {
+  const struct fncache_fn *fn = fncache_find(&cg->fc, hash);
+  const u8 *base = (const u8 *)cg->fc.old;
+  const u32 *calls;
+  struct x64_fixup *fixup;
+  u64 i, start, amount = 0;
+  if (!fn) return false;
+  for (i = 0; i < ir_len(&cg->ir); i++) amount += cg->ir.ops[i] == IR_CALL;
+  calls = (const u32 *)(base + fn->calls);
+  if (amount != fn->calls_len) return false;
+  for (i = 0; i < amount; i++) {
+    if (calls[i] > fn->len || fn->len - calls[i] < 4) return false;
+  }
+  x64_label_place(&cg->x64, label);
+  start = tape_len(cg->x64.code);
+  (void)mem_copy(x64_emit(&cg->x64, fn->len), base + fn->code, fn->len);
+  for (i = 0, amount = 0; i < ir_len(&cg->ir); i++) {
+    if (cg->ir.ops[i] != IR_CALL) continue;
+    assert((fixup = tape_push(cg->x64.fixups, struct x64_fixup)) != 0, "exceeded maximum fixup amount");
+    fixup->offset = start + calls[amount++];
+    fixup->label  = cg->labels[cg->ir.a[i]];
+  }
+  fncache_add(&cg->fc, hash, base + fn->code, fn->len, calls, fn->calls_len);
+  return true;
+}
+
+/* the calls of the code just made for the function, from 'start' on, go to the cache with their rel32 */
+static void
+codegen_cache(struct codegen *cg, u64 hash, u64 start, u64 fixups) {
+  u32 *calls;
+  u64 i;
+  assert(tape_clear(cg->fc.rel32), "couldn't clear code cache calls");
+  for (i = fixups; i < tape_len(cg->x64.fixups); i++) {
+    assert((calls = tape_push(cg->fc.rel32, u32)) != 0, "exceeded maximum code cache calls");
+    *calls = cg->x64.fixups[i].offset - start;
+  }
+  fncache_add(&cg->fc, hash, cg->x64.code + start, tape_len(cg->x64.code) - start, cg->fc.rel32, tape_len(cg->fc.rel32));
+}
+
+static void
+codegen_function(struct codegen *cg, u64 def) {
+  u64 i, reg, params, label, hash = 0, start, fixups;
+  cg->fn = cg->ast->rhs[def];
+  params = ast_list_len(cg->ast, ast_fn_params(cg->ast, cg->fn));
+  label  = cg->labels[codegen_sym(cg, def)];
+  ir_clear(&cg->ir);
+  for (i = 0; i < params; i++) (void)ir_value_make(&cg->ir, IR_PARAM, i, 0);
+  (void)ir_value_make(&cg->ir, IR_RET, codegen_lower(cg, cg->ast->rhs[cg->fn]), 0);
+  ir_fold(&cg->ir);
+  ir_dce(&cg->ir);
+  if (cg->is_cached) {
+    hash = codegen_hash(cg);
+    if (codegen_cached(cg, label, hash)) return;
+  }
+  regalloc_run(&cg->ra, &cg->ir);
+  x64_label_place(&cg->x64, label);
+  start  = tape_len(cg->x64.code);
+  fixups = tape_len(cg->x64.fixups);
+  if (cg->ra.frame) {
+    x64_push(&cg->x64, X64_RBP);
+    x64_mov_rr(&cg->x64, X64_RBP, X64_RSP);
+  }
+  for (reg = 0; reg < 16; reg++) {
+    if (cg->ra.saved >> reg & 1) x64_push(&cg->x64, reg);
+  }
+  if (cg->ra.spills) x64_alu_ri(&cg->x64, X64_SUB, X64_RSP, cg->ra.spills * 8);
+  codegen_parameters(cg, params);
+  for (i = 0; i < ir_len(&cg->ir); i++) codegen_emit(cg, i);
+  if (cg->is_cached) codegen_cache(cg, hash, start, fixups);
+}
+
+/* on executables label 0 is '_start', which calls 'main' and exits with its result. the modules share one
+ * module scope and their code goes out on command line order. 'names' is the interner of the whole build */
+struct x64
+ast_to_x64(struct module *modules, u64 amount, struct interner *names, u64 is_object, struct string_builder *text) {
+  struct codegen cg;
+  struct string name;
+  const struct ast *ast;
+  char path[PATH_MAX];
+  u64 root, m, i, def, sym, main_sym, syms, key, entry = 0;
+  cg.modules = modules;
+  cg.fn = 0;
+  cg.x64 = x64_make(text);
+  cg.ir  = ir_make();
+  cg.ra  = regalloc_make();
+  cg.fc  = fncache_make();
+  if (!is_object) {
+    name = string_make("_start", 0);
+    entry = x64_label_make(&cg.x64, &name, false);
+  }
+  name = string_make("main", 0);
+  main_sym = interner_intern(names, &name);
+  syms = tape_len(names->names);
+  cg.defs        = tape_make(sizeof (u32), syms);
+  cg.def_modules = tape_make(sizeof (u32), syms);
+  cg.labels      = tape_make(sizeof (u32), syms);
+  assert(cg.defs && cg.def_modules && cg.labels && tape_grow(cg.defs, syms, u32) && tape_grow(cg.def_modules, syms, u32) &&
+         tape_grow(cg.labels, syms, u32), "couldn't make symbol tables");
+  (void)mem_set(cg.defs, 0, syms * sizeof (u32));
+  cg.ce = consteval_make(syms);
+  for (m = 0; m < amount; m++) {
+    codegen_enter(&cg, m);
+    ast = cg.ast;
+    root = ast->lhs[0];
+    for (i = 0; i < ast_list_len(ast, root); i++) {
+      def = ast_list_get(ast, root, i);
+      if (ast->kinds[def] == AST_DEF_VAR) codegen_error(&cg, def, "module-scope variables aren't supported yet");
+      if (ast->kinds[def] != AST_DEF_CON) codegen_error(&cg, def, "only definitions are allowed at module scope");
+      sym = codegen_sym(&cg, def);
+      if (cg.defs[sym]) codegen_error(&cg, def, "symbol redefinition");
+      cg.defs[sym] = def;
+      cg.def_modules[sym] = m;
+      if (ast->kinds[ast->rhs[def]] == AST_FN) cg.labels[sym] = x64_label_make(&cg.x64, codegen_name(&cg, def), true);
+    }
+  }
+  /* every constant is evaluated, even the unused ones, so their errors aren't missed */
+  for (m = 0; m < amount; m++) {
+    codegen_enter(&cg, m);
+    ast = cg.ast;
+    root = ast->lhs[0];
+    for (i = 0; i < ast_list_len(ast, root); i++) {
+      def = ast_list_get(ast, root, i);
+      if (ast->kinds[ast->rhs[def]] != AST_FN) (void)consteval_constant(&cg, codegen_sym(&cg, def), def);
+    }
+  }
+  if (text) {
+    if (is_object) {
+      x64_text_cstr(&cg.x64, "format ELF64\nsection '.text' executable\n");
+      for (i = 0; i < tape_len(cg.x64.labels); i++) {
+        if (!cg.x64.labels[i].is_public) continue;
+        x64_text_cstr(&cg.x64, "public ");
+        x64_text_string(&cg.x64, &cg.x64.labels[i].name);
+        x64_text_end(&cg.x64);
+      }
+    } else {
+      x64_text_cstr(&cg.x64, "format ELF64 executable 3\nsegment readable executable\nentry _start\n");
+    }
+  }
+  if (!is_object) {
+    assert(cg.defs[main_sym] && codegen_is_fn(&cg, main_sym), "there's no 'main' function to start from");
+    x64_label_place(&cg.x64, entry);
+    x64_call(&cg.x64, cg.labels[main_sym]);
+    x64_mov_rr(&cg.x64, X64_RDI, X64_RAX);
+    x64_mov_ri(&cg.x64, X64_RAX, SYS_EXIT);
+    x64_syscall(&cg.x64);
+  }
+  /* the cache is written before linking, so the rel32 it keeps are still blank */
+  for (m = 0; m < amount; m++) {
+    codegen_enter(&cg, m);
+    ast = cg.ast;
+    root = ast->lhs[0];
+    key = hash_bytes(modules[m].src.file_path.buf, modules[m].src.file_path.len);
+    cg.is_cached = !text && cache_path(path, sizeof (path), key, ".code");
+    if (cg.is_cached) fncache_begin(&cg.fc, path);
+    for (i = 0; i < ast_list_len(ast, root); i++) {
+      def = ast_list_get(ast, root, i);
+      if (ast->kinds[ast->rhs[def]] == AST_FN) codegen_function(&cg, def);
+    }
+    if (cg.is_cached) (void)fncache_end(&cg.fc, path); /* a read-only directory just means there's no cache */
+  }
+  x64_link(&cg.x64);
+  (void)ir_destroy(&cg.ir);
+  (void)regalloc_destroy(&cg.ra);
+  (void)consteval_destroy(&cg.ce);
+  (void)fncache_destroy(&cg.fc);
+  (void)tape_destroy(cg.defs);
+  (void)tape_destroy(cg.def_modules);
+  (void)tape_destroy(cg.labels);
+  return cg.x64;
+}
+
+/* in-process JIT, for running stark functions like 'compipe' and 'precompipe' while compiling. the modules are
+ * compiled like a relocatable object, which only has relative calls, so the code runs wherever it's put and
+ * needs no relocations. the code goes to an image together with a table of its functions, the image is
+ * flipped to executable and run right where it is, and the same image is what the cache file holds. every
+ * function gets an entry that takes system v arguments, since it's called from C */
+typedef u64 (*jit_fn)(u64, u64, u64, u64, u64, u64);
+
+#define JIT_MAGIC 0x00746a6372617473ul /* "starcjt" */
+
+struct jit_header {
+  u64 magic;
+  u64 compiler; /* 'caches.compiler' of the starc that compiled it */
+  u64 hash;    /* of the source the code was compiled from */
+  u64 size;    /* of the whole image, header included */
+  u64 symbols; /* amount of 'struct jit_symbol' right after the header, their names come after them */
+  u64 code;    /* offset of the code from the header */
+};
+
+struct jit_symbol {
+  u64 name; /* offset from the header */
+  u64 name_len;
+  u64 entry; /* offset of the system v entry from the header */
+};
+
+struct jit {
+  const struct jit_header *image;
+  u8 *tape; /* the image when it was compiled here, 0 when it's mapped from a cache file */
+};
+
+struct jit
+jit_make(struct module *modules, u64 module_amount, struct interner *interner, u64 hash) {
+  struct x64 x64;
+  struct jit jit;
+  struct jit_header *header;
+  struct jit_symbol *symbols;
+  u64 i, labels, amount, names, size;
+  x64 = ast_to_x64(modules, module_amount, interner, true, 0);
+  labels = tape_len(x64.labels);
+  for (i = 0, amount = 0, names = 0; i < labels; i++) {
+    if (!x64.labels[i].is_public) continue;
+    amount++;
+    names += x64.labels[i].name.len;
+  }
+  size = (sizeof (struct jit_header) + amount * sizeof (struct jit_symbol) + names + 15) & ~15ul;
+  jit.tape = tape_make_with(sizeof (u8), 0, TAPE_DEFAULT|TAPE_UNPOOLED); /* it's flipped to executable */
+  assert(jit.tape && tape_grow(jit.tape, size, u8), "couldn't make JIT image");
+  header  = (struct jit_header *)jit.tape;
+  symbols = (struct jit_symbol *)(header + 1);
+  names   = sizeof (struct jit_header) + amount * sizeof (struct jit_symbol);
+  for (i = 0, amount = 0; i < labels; i++) {
+    if (!x64.labels[i].is_public) continue;
+    symbols[amount].name     = names;
+    symbols[amount].name_len = x64.labels[i].name.len;
+    symbols[amount].entry    = size + tape_len(x64.code);
+    (void)mem_copy(jit.tape + names, x64.labels[i].name.buf, x64.labels[i].name.len);
+    names += x64.labels[i].name.len;
+    amount++;
+    /* system v passes the third to sixth arguments on rdx, rcx, r8 and r9, stark passes them on r8 to r11 */
+    x64_mov_rr(&x64, X64_R11, X64_R9);
+    x64_mov_rr(&x64, X64_R10, X64_R8);
+    x64_mov_rr(&x64, X64_R9,  X64_RCX);
+    x64_mov_rr(&x64, X64_R8,  X64_RDX);
+    x64_jmp(&x64, i);
+  }
+  x64_link(&x64);
+  assert(tape_grow(jit.tape, tape_len(x64.code), u8) != 0, "exceeded maximum JIT image size");
+  (void)mem_copy(jit.tape + size, x64.code, tape_len(x64.code));
+  header->magic   = JIT_MAGIC;
+  header->compiler = caches.compiler;
+  header->hash    = hash;
+  header->size    = tape_len(jit.tape);
+  header->symbols = amount;
+  header->code    = size;
+  (void)x64_destroy(&x64);
+  assert(tape_protect(jit.tape, PROT_READ|PROT_EXEC), "couldn't make the JIT code executable");
+  jit.image = header;
+  return jit;
+}
+
+/* maps the cache file at 'path' straight as code, 'image' is 0 when it's missing or not for 'hash' */
+struct jit
+jit_load(const char *path, u64 hash) {
+  struct jit jit;
+  struct stat st;
+  const struct jit_header *image;
+  u64 fd;
+  jit.image = 0;
+  jit.tape  = 0;
+  fd = open(path, O_RDONLY, 0);
+  if (is_neg(fd)) return jit;
+  image = MAP_FAILED;
+  if (!is_neg(fstat(fd, &st)) && st.st_size >= sizeof (struct jit_header)) {
+    image = mmap(0, st.st_size, PROT_READ|PROT_EXEC, MAP_PRIVATE, fd, 0);
+  }
+  (void)close(fd);
+  if (image == MAP_FAILED) return jit;
+  if (image->magic != JIT_MAGIC || image->compiler != caches.compiler || image->hash != hash ||
+      image->size != st.st_size || image->code > image->size ||
+      image->symbols > (image->code - sizeof (struct jit_header)) / sizeof (struct jit_symbol)) {
+    (void)munmap((void *)image, st.st_size);
+    return jit;
+  }
+  jit.image = image;
+  return jit;
+}
+
+u64
+jit_save(const struct jit *jit, const char *path) {
+  return cache_write(path, jit->image, jit->image->size);
+}
+
+u64
+jit_destroy(struct jit *jit) {
+  u64 res;
+  if (!jit || !jit->image) return false;
+  res = jit->tape ? tape_destroy(jit->tape) : munmap((void *)jit->image, jit->image->size) == 0;
+  jit->image = 0;
+  jit->tape  = 0;
+  return res;
+}
+
+/* the function named 'name', 0 when the module doesn't define it */
+jit_fn
+jit_symbol(const struct jit *jit, const char *name) {
+  const struct jit_symbol *symbols = (const struct jit_symbol *)(jit->image + 1);
+  const u8 *base = (const u8 *)jit->image;
+  u64 i, len = cstring_len(name);
+  jit_fn fn = 0;
+  for (i = 0; i < jit->image->symbols; i++) {
+    if (symbols[i].name_len != len || symbols[i].name + len > jit->image->code) continue;
+    if (!mem_eq(base + symbols[i].name, name, len) || symbols[i].entry >= jit->image->size) continue;
+    *(void **)&fn = (void *)(base + symbols[i].entry); /* iso c has no cast from data to function pointers */
+    break;
+  }
+  return fn;
+}
+
+/* entry point, '_start' on helper.s passes the process arguments */
+#define STARC_USAGE "usage: starc [-c | -r] [-S | -F] [-o output] [-C cache] file...\n" \
+                    "  -c  write a relocatable object instead of an executable\n" \
+                    "  -r  run 'main' in-process with the JIT, exiting with its result\n" \
+                    "  -S  write fasm source instead of machine code, for debugging\n" \
+                    "  -F  assemble with fasm instead of the built-in encoder\n" \
+                    "  -o  output path, 'a.out' by default\n" \
+                    "  -C  cache directory, made when it's missing. nothing is cached without it\n" \
+                    "every file is a module"
+void
+starc_main(u64 argc, char **argv, char **envp) {
+  struct module *modules;
+  struct interner names;
+  struct pool pool;
+  struct x64 x64;
+  struct jit jit;
+  jit_fn main_fn;
+  struct string_builder text;
+  const char *output, *cache_dir, **inputs;
+  char *fasm_argv[4];
+  char cache[PATH_MAX];
+  u64 i, amount, is_object, is_text, is_fasm, is_run, is_cached, hash, key;
+  u8 *out;
+
+  mem_init();
+  (void)tape_pool_init(); /* every tape is mapped on its own without it */
+  io_make();
+
+  inputs    = tape_make(sizeof (const char *), 0);
+  assert(inputs != 0, "couldn't make input buffer");
+  output    = 0;
+  cache_dir = 0;
+  is_object = false;
+  is_text   = false;
+  is_fasm   = false;
+  is_run    = false;
+  for (i = 1; i < argc; i++) {
+    if (argv[i][0] == '-' && argv[i][1] != '\0') {
+      assert(argv[i][2] == '\0', STARC_USAGE);
+      switch (argv[i][1]) {
+        case 'c': is_object = true; break;
+        case 'S': is_text   = true; break;
+        case 'F': is_fasm   = true; break;
+        case 'r': is_run    = true; break;
+        case 'o': {
+          assert(i + 1 < argc, STARC_USAGE);
+          output = argv[++i];
+        } break;
+        case 'C': {
+          assert(i + 1 < argc, STARC_USAGE);
+          cache_dir = argv[++i];
+        } break;
+        default: assert(false, STARC_USAGE);
+      }
+      continue;
+    }
+    assert(tape_push(inputs, const char *) != 0, "exceeded maximum input amount");
+    inputs[tape_len(inputs) - 1] = argv[i];
+  }
+  amount = tape_len(inputs);
+  assert(amount != 0 && !(is_text && is_fasm) && !(is_run && (is_object || is_text || is_fasm || output)), STARC_USAGE);
+  if (!output) output = is_text ? "a.asm" : is_object ? "a.o" : "a.out";
+  if (cache_dir) (void)caches_init(cache_dir); /* a directory that can't be used just means there's no cache */
+
+  /* the files are read here, in order, so stdin is only read once and the same input is always a hit */
+  modules = tape_make(sizeof (struct module), amount);
+  assert(modules && tape_grow(modules, amount, struct module), "couldn't make module buffer");
+  hash = amount;
+  key  = amount;
+  for (i = 0; i < amount; i++) {
+    key = key * 0x100000001b3ul ^ hash_bytes(inputs[i], cstring_len(inputs[i]));
+    modules[i].src = file_to_source(inputs[i]);
+    modules[i].src.module = i;
+    modules[i].hash = hash_bytes(modules[i].src.data.buf, modules[i].src.data.len);
+    hash = hash * 0x100000001b3ul ^ modules[i].hash;
+  }
+  names = interner_make();
+  i     = cpu_count();
+  pool  = pool_make(amount < i ? amount : i);
+
+  if (is_run) {
+    /* the code is cached by the paths of the sources and checked against their content, a hit skips the whole
+     * front end */
+    is_cached = cache_path(cache, sizeof (cache), key, ".jit");
+    jit.image = 0;
+    if (is_cached) jit = jit_load(cache, hash);
+    if (!jit.image) {
+      modules_front_end(modules, amount, &pool, &names);
+      jit = jit_make(modules, amount, &names, hash);
+      if (is_cached) (void)jit_save(&jit, cache); /* a read-only directory just means there's no cache */
+    }
+    main_fn = jit_symbol(&jit, "main");
+    assert(main_fn != 0, "there's no 'main' function to run");
+    exit(main_fn(0, 0, 0, 0, 0, 0));
+  }
+
+  modules_front_end(modules, amount, &pool, &names);
+  (void)pool_destroy(&pool);
+  if (is_text || is_fasm) {
+    text = string_builder_begin(0);
+    assert(text.buf != 0, "couldn't make fasm output buffer");
+    /* fasm seeks its source to learn the size, so it can't read from a pipe. a memfd is a file that never
+     * touches the disk, the fasm source is flushed into it in chunks while the code is generated and fasm
+     * only runs on it once it's complete, so assembling doesn't overlap code generation */
+    text.fd = is_fasm ? memfd_create("starc.asm", MFD_CLOEXEC) : open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(!is_neg(text.fd), "couldn't open fasm output file");
+  }
+  x64 = ast_to_x64(modules, amount, &names, is_object, is_text || is_fasm ? &text : 0);
+  if (is_text || is_fasm) assert(string_builder_flush(&text), "couldn't write fasm output");
+  if (is_fasm) {
+    fasm_argv[0] = "fasm";
+    fasm_argv[1] = "/dev/stdin";
+    fasm_argv[2] = (char *)output;
+    fasm_argv[3] = 0;
+    assert(process_run(fasm_argv[0], fasm_argv, envp, text.fd) == 0, "couldn't assemble the output with fasm");
+  } else if (!is_text) {
+    out = is_object ? elf_make_object(&x64) : elf_make_executable(&x64, 0);
+    assert(file_write(output, out, tape_len(out), is_object ? 0644 : 0755), "couldn't write output file");
+  }
 
 #if 0
   {
     u64 i;
     io_clear();
-    for (i = 0; i < tape_len(tokens); i++) {
-      struct source_position pos = token_get_position(&src, &tokens[i]);
-      struct string type = token_to_string(tokens[i].type);
-      (void)source_error_location_to_io(&src, &pos);
+    for (i = 0; i < lexer_len(&modules[0].lexer); i++) {
+      struct token tok = lexer_token(&modules[0].lexer, i);
+      struct source_position pos = token_get_position(&modules[0].src, &tok);
+      struct string type = token_to_string(tok.type);
+      (void)source_error_location_to_io(&modules[0].src, &pos);
       io_append(&type);
       io_append_cstr(" '");
       io_set_bold_white();
-      io_append(&tokens[i].data);
+      io_append(&tok.data);
       io_reset();
       io_append_cstr("'\n");
-      (void)token_error_code_snippet_to_io(&src, &tokens[i]);
+      (void)token_error_code_snippet_to_io(&modules[0].src, &tok);
     }
     io_print();
   }
@@ -1344,3 +5113,4 @@ _start(void) {
 
   exit(0);
 }
+#undef STARC_USAGE